@@ -1,37 +1,74 @@
 import sdi
 import datetime
 import socket
+import struct
 
 class Detectron :
-    NCHAN = 7
+    NCHAN = 8
+    NCOINC = 4
 
     def trig(self) :
         return self.query('*TRG')
 
+    def fetch_data(self, count=None) :
+        data = self.query_block(':DATA:FETCh?' + ('' if count is None else ' %d' % count))
+        return [struct.unpack_from('<IBB', data, 6*j) for j in range(0, len(data) // 6)] if data is not None else None
+
+    def freq(self, chan=8) :
+        return float(self.query(':INput%d:FREQuency?' % chan))
+
+    def hist(self, chan=1) :
+        return [int(s) for s in self.query(':INput%d:HISTogram?' % chan).split(',')]
+
+    def dump_data(self) :
+        self.dump([':DATA:' + s for s in ['ENable', 'COUNt', 'OVERflow']])
+
     def dump_output(self) :
-        self.dump([':OUTput:' + s for s in ['SERial:ENable', 'UDP:ENable', 'UDP:DESTination', 'UDP:PORT']])
+        self.dump([':OUTput:' + s for s in ['SERial:ENable', 'SERial:FORMat', 'UDP:ENable', 'UDP:DESTination', 'UDP:PORT', 'UDP:BATCh', 'UDP:LATency']])
+
+    def dump_coinc(self) :
+        self.dump([':COINcidence:' + s for s in ['WINDow', 'ONLY']])
+        for g in range(1, self.NCOINC + 1) :
+            self.dump([':COINcidence%d:' % g + s for s in ['MASK', 'COUNt']])
 
     def dump_input(self, chan=1) :
-        self.dump([':INput%d:' % chan + s for s in ['MODe', 'PULLup', 'INVert', 'COUNt', 'VALue']])
+        self.dump([':INput%d:' % chan + s for s in ['MODe', 'PULLup', 'INVert', 'COUNt', 'VALue', 'FILTer', 'REJected', 'RATE', 'HISTogram']])
 
     def dump_all(self, short=False) :
         print('device info:')
         self.dump(['*IDN'])
         print('output config:')
         self.dump_output()
+        print('coincidence config:')
+        self.dump_coinc()
+        print('recorder config:')
+        self.dump_data()
         print('input config:')
+        self.dump([':INput:' + s for s in ['WINDow', 'RATE', 'GATE']])
         for chan in range(1, self.NCHAN + 1) :
             self.dump_input(chan=chan)
+        print('serial config:')
+        self.dump_serial()
         print('network config:')
         self.dump_lan()
 
 class DetectronSerial(Detectron, sdi.SDISerial) :
 
     def listen(self) :
+        binary = self.query(':OUTput:SERial:FORMat?').strip() == 'BINARY'
         timeout = self.timeout
         self.timeout = None
         try :
             while True :
+                if binary :
+                    frame = self.read_frame()
+                    dt = datetime.datetime.now()
+                    if frame is None :
+                        print('%s BAD FRAME' % dt)
+                        continue
+                    (y_old, y_new, t) = frame
+                    print('%s %.6f 0x%x -> 0x%x %s' % (dt, t*TICK, y_old, y_new, decode_edges(y_old, y_new)))
+                    continue
                 data = self.readline()
                 dt = datetime.datetime.now()
                 y_old = ord(data[0]);
@@ -40,6 +77,17 @@ class DetectronSerial(Detectron, sdi.SDISerial) :
         except (KeyboardInterrupt, SystemExit) : pass
         finally : self.timeout = timeout
 
+    def read_frame(self) :
+        while self.read(1) != FRAME_SYNC : pass  # skip replies and partial frames
+        data = ''
+        while True :
+            b = self.read(1)
+            if b == FRAME_SYNC :
+                if data == '' : continue  # started on the closing sync of a previous frame
+                break
+            data += chr(ord(self.read(1)) ^ 0x20) if b == FRAME_ESC else b
+        return decode_frame(data)
+
 class DetectronSocket(Detectron, sdi.SDISocket) : pass
 
 def decode_edges(y_old, y_new) :
@@ -50,15 +98,42 @@ def decode_edges(y_old, y_new) :
         if x_old != x_new : rv[chr(ord('A') + n)] = 'RISING' if x_new else 'FALLING'
     return rv
 
-def listen_udp(if_addr='', port=5000) :
+TICK = 0.5e-6  # device timestamp unit in s
+
+FRAME_SYNC = '\x7e'
+FRAME_ESC  = '\x7d'
+
+def decode_frame(data) :
+    if len(data) != 7 or sum(bytearray(data)) % 256 != 0 : return None
+    return struct.unpack('<BBI', data[:6])
+
+def decode_batch(data) :
+    (seq, t_base, count) = struct.unpack_from('<IIB', data, 0)
+    events = []
+    t = t_base
+    for j in range(0, count) :
+        (y_old, y_new, dt) = struct.unpack_from('<BBH', data, 9 + 4*j)
+        t += dt
+        events.append((t, y_old, y_new))
+    return (seq, events)
+
+def listen_udp(if_addr='', port=5000) :  # for high rates, see detectron_recv.cpp
     sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
     sock.bind((if_addr, port))
+    seq_next = None
     try :
         while True :
-            (data, (addr, port)) = sock.recvfrom(2)
+            (data, (addr, port)) = sock.recvfrom(1024)
             dt = datetime.datetime.now()
-            y_old = ord(data[0]);
-            y_new = ord(data[1]);
-            print('%s %s 0x%x -> 0x%x %s' % (dt, addr, y_old, y_new, decode_edges(y_old, y_new)))
+            if len(data) == 2 :  # one event per datagram
+                y_old = ord(data[0]);
+                y_new = ord(data[1]);
+                print('%s %s 0x%x -> 0x%x %s' % (dt, addr, y_old, y_new, decode_edges(y_old, y_new)))
+                continue
+            (seq, events) = decode_batch(data)
+            if seq_next is not None and seq != seq_next : print('%s %s LOST %d DATAGRAMS' % (dt, addr, (seq - seq_next) % 2**32))
+            seq_next = (seq + 1) % 2**32
+            for (t, y_old, y_new) in events :
+                print('%s %s %.6f 0x%x -> 0x%x %s' % (dt, addr, t*TICK, y_old, y_new, decode_edges(y_old, y_new)))
     except (KeyboardInterrupt, SystemExit) : pass
     finally : sock.close()
@@ -0,0 +1,539 @@
+// description: high-throughput receiver for detectron UDP event streams (Linux)
+
+// build:
+//   g++ -O2 -std=c++11 -pthread -o detectron_recv detectron_recv.cpp
+
+// usage:
+//   detectron_recv listen <port> <log> [-v]                       receive until Ctrl-C, append to <log>.evt and <log>.idx
+//   detectron_recv loadgen <host> <port> <events/s> <s> [batch]   send synthetic batched datagrams, 0 events/s = flat out
+//   detectron_recv bench [s] [batch]                              load generator and receiver over loopback, reports events/s and loss
+
+// notes:
+//   - datagrams are read up to VLEN at a time with recvmmsg(), each with its kernel receive timestamp (SO_TIMESTAMPNS)
+//   - both device formats are accepted: 2-byte (y_old, y_new) and batched (see instruments/arduino/detectron/eeprom/shared.h),
+//     lost datagrams are detected from the batch sequence numbers, per source
+//   - <log>.evt is a LOG_HDR followed by one EVENT per event, <log>.idx a LOG_HDR followed by one INDEX per datagram,
+//     both are memory-mapped, grown in steps of GROW bytes, and trimmed to size on exit (count in the header)
+//   - -v prints each event like demos/detectron.py listen_udp()
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#define VLEN      64         // datagrams per recvmmsg()/sendmmsg()
+#define DGLEN     1024       // max datagram size
+#define NBATCH    32         // max events per batched datagram, as on the device
+#define BATCH_HDR 9          // uint32 sequence number, uint32 timestamp base, byte count
+#define NSRC      16         // sources tracked for loss detection
+#define GROW      (1 << 24)  // log mapping step in bytes
+#define TICK      0.5e-6     // device timestamp unit in s
+
+#define EV_LEGACY 0x1  // from a 2-byte datagram, no device timestamp
+
+struct LOG_HDR
+{
+    char     magic[8];  // "DTRLOG1" (events) or "DTRIDX1" (index)
+    uint32_t rec_size;
+    uint32_t reserved;
+    uint64_t count;
+};
+
+struct EVENT
+{
+    uint64_t host_ns;  // kernel receive time of the datagram, CLOCK_REALTIME
+    uint32_t t;        // device timestamp in ticks
+    uint8_t  y_old;
+    uint8_t  y_new;
+    uint16_t flags;
+};
+
+struct INDEX
+{
+    uint64_t host_ns;
+    uint64_t first;     // EVENT number of the first event
+    uint32_t seq;       // batch sequence number, 0 for 2-byte datagrams
+    uint32_t lost;      // datagrams missing from this source just before this one
+    uint32_t src_addr;  // network byte order
+    uint16_t src_port;  // network byte order
+    uint16_t count;
+};
+
+struct MAPPED
+{
+    int    fd;
+    char  *base;
+    size_t cap;  // bytes mapped
+    size_t len;  // bytes used
+};
+
+struct SOURCE
+{
+    uint32_t addr;
+    uint16_t port;
+    bool     valid;
+    uint32_t seq_next;
+};
+
+struct RECEIVER
+{
+    int      sock;
+    MAPPED   evt;
+    MAPPED   idx;
+    SOURCE   src[NSRC];
+    bool     verbose;
+    uint64_t datagrams;
+    uint64_t events;
+    uint64_t lost;
+    uint64_t bad;
+};
+
+static std::atomic<bool> stop(false);
+
+static void on_signal(int) { stop = true; }
+
+static uint64_t now_ns(const clockid_t clock)
+{
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t get_u32(const uint8_t *src) { return src[0] | src[1] << 8 | src[2] << 16 | (uint32_t)src[3] << 24; }
+static uint16_t get_u16(const uint8_t *src) { return src[0] | src[1] << 8; }
+
+static void put_u32(uint8_t *dest, const uint32_t x)
+{
+    for (int j = 0; j < 4; j++) { dest[j] = x >> (8*j); }
+}
+
+// memory-mapped append-only files:
+
+static bool map_open(MAPPED &m, const char *path, const char *magic, const uint32_t rec_size)
+{
+    m.fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m.fd < 0 || ftruncate(m.fd, GROW) != 0) { perror(path); return 0; }
+
+    m.base = (char *)mmap(NULL, GROW, PROT_READ | PROT_WRITE, MAP_SHARED, m.fd, 0);
+    if (m.base == MAP_FAILED) { perror(path); return 0; }
+    m.cap = GROW;
+    m.len = sizeof(LOG_HDR);
+
+    LOG_HDR *hdr = (LOG_HDR *)m.base;
+    memcpy(hdr->magic, magic, sizeof(hdr->magic));  // 7 characters and a null-terminator
+    hdr->rec_size = rec_size;
+    hdr->reserved = 0;
+    hdr->count    = 0;
+    return 1;
+}
+
+static void *map_append(MAPPED &m, const size_t n)  // space for n more bytes, valid until the next call
+{
+    if (m.len + n > m.cap)
+    {
+        const size_t cap = m.cap + GROW;
+        if (ftruncate(m.fd, cap) != 0) { perror("ftruncate"); exit(1); }
+
+        void *base = mremap(m.base, m.cap, cap, MREMAP_MAYMOVE);
+        if (base == MAP_FAILED) { perror("mremap"); exit(1); }
+        m.base = (char *)base;
+        m.cap  = cap;
+    }
+
+    void *p = m.base + m.len;
+    m.len += n;
+    ((LOG_HDR *)m.base)->count++;
+    return p;
+}
+
+static void map_close(MAPPED &m)
+{
+    munmap(m.base, m.cap);
+    if (ftruncate(m.fd, m.len) != 0) { perror("ftruncate"); }
+    close(m.fd);
+}
+
+// receiver:
+
+static int open_socket(const uint16_t port, const bool timestamps)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) { perror("socket"); exit(1); }
+
+    int on = 1;
+    int rcvbuf = 1 << 23;
+    timeval to = {0, 100000};  // so stop is noticed while idle
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on,     sizeof(on));
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF,    &rcvbuf, sizeof(rcvbuf));
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO,  &to,     sizeof(to));
+    if (timestamps) { setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)); }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(port);
+    if (bind(sock, (sockaddr *)&addr, sizeof(addr)) != 0) { perror("bind"); exit(1); }
+    return sock;
+}
+
+static uint32_t source_lost(RECEIVER &r, const sockaddr_in &from, const uint32_t seq)  // datagrams skipped since the last one from this source
+{
+    int k = 0;
+    while (k < NSRC && r.src[k].valid && !(r.src[k].addr == from.sin_addr.s_addr && r.src[k].port == from.sin_port)) { k++; }
+    if (k == NSRC) { return 0; }  // too many sources, not tracked
+
+    SOURCE &s = r.src[k];
+    const uint32_t lost = s.valid ? seq - s.seq_next : 0;
+    s.addr     = from.sin_addr.s_addr;
+    s.port     = from.sin_port;
+    s.valid    = 1;
+    s.seq_next = seq + 1;
+    return lost < 0x80000000 ? lost : 0;  // reordered or restarted
+}
+
+static void print_event(const EVENT &e, const sockaddr_in &from)
+{
+    printf("%.9f %s %.6f 0x%x -> 0x%x {", e.host_ns*1e-9, inet_ntoa(from.sin_addr), e.t*TICK, e.y_old, e.y_new);
+    for (int n = 0; n < 8; n++)
+    {
+        const int x_old = (e.y_old >> n) & 0x1;
+        const int x_new = (e.y_new >> n) & 0x1;
+        if (x_old != x_new) { printf(" %c: %s", 'A' + n, x_new ? "RISING" : "FALLING"); }
+    }
+    printf(" }\n");
+}
+
+static void handle_datagram(RECEIVER &r, const uint8_t *data, const size_t len, const uint64_t host_ns, const sockaddr_in &from)
+{
+    int      count;
+    uint32_t seq = 0;
+    uint32_t t   = 0;
+    if (len == 2) { count = 1; }
+    else if (len >= BATCH_HDR)
+    {
+        seq   = get_u32(data);
+        t     = get_u32(data + 4);
+        count = data[8];
+        if (len != (size_t)BATCH_HDR + 4*count) { r.bad++; return; }
+    }
+    else { r.bad++; return; }
+
+    INDEX *x = (INDEX *)map_append(r.idx, sizeof(INDEX));
+    x->host_ns  = host_ns;
+    x->first    = r.events;
+    x->seq      = seq;
+    x->lost     = (len == 2) ? 0 : source_lost(r, from, seq);
+    x->src_addr = from.sin_addr.s_addr;
+    x->src_port = from.sin_port;
+    x->count    = count;
+    r.lost += x->lost;
+    r.datagrams++;
+
+    for (int j = 0; j < count; j++)
+    {
+        EVENT *e = (EVENT *)map_append(r.evt, sizeof(EVENT));
+        e->host_ns = host_ns;
+        if (len == 2)
+        {
+            e->t     = 0;
+            e->y_old = data[0];
+            e->y_new = data[1];
+            e->flags = EV_LEGACY;
+        }
+        else
+        {
+            const uint8_t *rec = data + BATCH_HDR + 4*j;
+            t += get_u16(rec + 2);
+            e->t     = t;
+            e->y_old = rec[0];
+            e->y_new = rec[1];
+            e->flags = 0;
+        }
+        if (r.verbose) { print_event(*e, from); }
+    }
+    r.events += count;
+}
+
+static void receive(RECEIVER &r)
+{
+    static uint8_t bufs[VLEN][DGLEN];
+    static char    ctrl[VLEN][CMSG_SPACE(sizeof(timespec))];
+    mmsghdr        msgs[VLEN];
+    iovec          iov [VLEN];
+    sockaddr_in    from[VLEN];
+
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < VLEN; i++)
+    {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len  = DGLEN;
+        msgs[i].msg_hdr.msg_iov     = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen  = 1;
+        msgs[i].msg_hdr.msg_name    = &from[i];
+        msgs[i].msg_hdr.msg_control = ctrl[i];
+    }
+
+    while (!stop)
+    {
+        for (int i = 0; i < VLEN; i++)
+        {
+            msgs[i].msg_hdr.msg_namelen    = sizeof(from[i]);
+            msgs[i].msg_hdr.msg_controllen = sizeof(ctrl[i]);
+        }
+
+        const int n = recvmmsg(r.sock, msgs, VLEN, MSG_WAITFORONE, NULL);  // blocks for the first, takes whatever else is queued
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) { continue; }
+            perror("recvmmsg");
+            break;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            uint64_t host_ns = 0;
+            for (cmsghdr *c = CMSG_FIRSTHDR(&msgs[i].msg_hdr); c != NULL; c = CMSG_NXTHDR(&msgs[i].msg_hdr, c))
+            {
+                if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS)
+                {
+                    timespec ts;
+                    memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+                    host_ns = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+                }
+            }
+            if (host_ns == 0) { host_ns = now_ns(CLOCK_REALTIME); }  // timestamps unavailable
+
+            handle_datagram(r, bufs[i], msgs[i].msg_len, host_ns, from[i]);
+        }
+    }
+}
+
+static bool receiver_open(RECEIVER &r, const uint16_t port, const char *log, const bool verbose)
+{
+    memset(&r, 0, sizeof(r));
+    r.verbose = verbose;
+    r.sock    = open_socket(port, 1);
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s.evt", log);
+    if (!map_open(r.evt, path, "DTRLOG1", sizeof(EVENT))) { return 0; }
+    snprintf(path, sizeof(path), "%s.idx", log);
+    if (!map_open(r.idx, path, "DTRIDX1", sizeof(INDEX))) { return 0; }
+    return 1;
+}
+
+static void receiver_close(RECEIVER &r)
+{
+    close(r.sock);
+    map_close(r.evt);
+    map_close(r.idx);
+}
+
+// load generator:
+
+struct LOADGEN
+{
+    uint64_t datagrams;
+    uint64_t events;
+};
+
+static LOADGEN loadgen(const sockaddr_in &dest, const double rate, const double seconds, const int batch_max)
+{
+    LOADGEN g = {0, 0};
+
+    const uint32_t dt    = rate > 0 ? (uint32_t)std::min(1 / (rate*TICK), (double)UINT32_MAX) : 1;  // ticks between events, as the device would stamp them
+    const int      batch = dt > 0xFFFF ? 1 : batch_max;  // the device ends a batch at gaps that do not fit the 16-bit record, i.e. below ~31 events/s
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) { perror("socket"); exit(1); }
+
+    static uint8_t bufs[VLEN][BATCH_HDR + 4*NBATCH];
+    mmsghdr        msgs[VLEN];
+    iovec          iov [VLEN];
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < VLEN; i++)
+    {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len  = BATCH_HDR + 4*batch;
+        msgs[i].msg_hdr.msg_iov     = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen  = 1;
+        msgs[i].msg_hdr.msg_name    = (void *)&dest;
+        msgs[i].msg_hdr.msg_namelen = sizeof(dest);
+    }
+
+    const uint64_t t_start = now_ns(CLOCK_MONOTONIC);
+    const uint64_t t_end   = t_start + (uint64_t)(seconds*1e9);
+    uint32_t       t       = 0;
+    uint8_t        y       = 0;
+
+    while (!stop)
+    {
+        const uint64_t t_now = now_ns(CLOCK_MONOTONIC);
+        if (t_now >= t_end) { break; }
+
+        int n = VLEN;
+        if (rate > 0)  // datagrams due by now
+        {
+            const uint64_t due = (uint64_t)((t_now - t_start)*1e-9*rate / batch) + 1;
+            n = due > g.datagrams ? (int)std::min<uint64_t>(due - g.datagrams, VLEN) : 0;
+            if (n == 0)
+            {
+                usleep(100);
+                continue;
+            }
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            uint8_t *buf = bufs[i];
+            put_u32(buf,     g.datagrams + i);
+            put_u32(buf + 4, t);
+            buf[8] = batch;
+            for (int j = 0; j < batch; j++)
+            {
+                uint8_t *rec = buf + BATCH_HDR + 4*j;
+                rec[0] = y;
+                rec[1] = y ^ 0x1;  // input A toggles
+                rec[2] = (j == 0 ? 0 : dt) & 0xFF;
+                rec[3] = (j == 0 ? 0 : dt) >> 8;
+                y ^= 0x1;
+                t += (j == 0 ? 0 : dt);
+            }
+            t += dt;
+        }
+
+        const int sent = sendmmsg(sock, msgs, n, 0);
+        if (sent < 0)
+        {
+            if (errno == ENOBUFS || errno == EAGAIN) { continue; }
+            perror("sendmmsg");
+            break;
+        }
+        g.datagrams += sent;
+        g.events    += (uint64_t)sent * batch;
+    }
+
+    close(sock);
+    return g;
+}
+
+static bool resolve(const char *host, const char *port, sockaddr_in &dest)
+{
+    addrinfo hints;
+    addrinfo *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host, port, &hints, &res) != 0) { return 0; }
+
+    memcpy(&dest, res->ai_addr, sizeof(dest));
+    freeaddrinfo(res);
+    return 1;
+}
+
+// commands:
+
+static int cmd_listen(const int argc, char **argv)
+{
+    if (argc < 4) { return 2; }
+
+    RECEIVER r;
+    if (!receiver_open(r, atoi(argv[2]), argv[3], argc > 4 && strcmp(argv[4], "-v") == 0)) { return 1; }
+
+    signal(SIGINT,  on_signal);
+    signal(SIGTERM, on_signal);
+    receive(r);
+
+    fprintf(stderr, "%llu datagrams, %llu events, %llu datagrams lost, %llu malformed\n",
+            (unsigned long long)r.datagrams, (unsigned long long)r.events, (unsigned long long)r.lost, (unsigned long long)r.bad);
+    receiver_close(r);
+    return 0;
+}
+
+static int cmd_loadgen(const int argc, char **argv)
+{
+    if (argc < 6) { return 2; }
+
+    sockaddr_in dest;
+    if (!resolve(argv[2], argv[3], dest)) { fprintf(stderr, "cannot resolve %s\n", argv[2]); return 1; }
+
+    const int batch = argc > 6 ? atoi(argv[6]) : NBATCH;
+    if (batch < 1 || batch > NBATCH) { fprintf(stderr, "batch must be 1 to %d\n", NBATCH); return 1; }
+
+    signal(SIGINT, on_signal);
+    const LOADGEN g = loadgen(dest, atof(argv[4]), atof(argv[5]), batch);
+    fprintf(stderr, "sent %llu datagrams, %llu events\n", (unsigned long long)g.datagrams, (unsigned long long)g.events);
+    return 0;
+}
+
+static int cmd_bench(const int argc, char **argv)
+{
+    const double seconds = argc > 2 ? atof(argv[2]) : 3;
+    const int    batch   = argc > 3 ? atoi(argv[3]) : NBATCH;
+    if (batch < 1 || batch > NBATCH) { fprintf(stderr, "batch must be 1 to %d\n", NBATCH); return 1; }
+
+    char log[64];
+    snprintf(log, sizeof(log), "/tmp/detectron_bench.%d", (int)getpid());
+
+    RECEIVER r;
+    if (!receiver_open(r, 0, log, 0)) { return 1; }
+
+    sockaddr_in dest;
+    socklen_t   dest_len = sizeof(dest);
+    getsockname(r.sock, (sockaddr *)&dest, &dest_len);
+    dest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    std::thread rx(receive, std::ref(r));
+    const uint64_t t0 = now_ns(CLOCK_MONOTONIC);
+    const LOADGEN  g  = loadgen(dest, 0, seconds, batch);
+    const double   dt = (now_ns(CLOCK_MONOTONIC) - t0)*1e-9;
+    usleep(200000);  // drain
+    stop = true;
+    rx.join();
+
+    printf("batch %d, %.2f s: sent %llu events in %llu datagrams, received %llu events (%.0f events/s, %.3g datagrams/s), "
+           "%llu datagrams lost (%.2f%%), log %.1f MB\n",
+           batch, dt, (unsigned long long)g.events, (unsigned long long)g.datagrams,
+           (unsigned long long)r.events, r.events / dt, r.datagrams / dt,
+           (unsigned long long)(g.datagrams - r.datagrams), g.datagrams ? 100.0*(g.datagrams - r.datagrams)/g.datagrams : 0.0,
+           (r.evt.len + r.idx.len) / 1e6);
+    receiver_close(r);
+
+    char path[80];
+    snprintf(path, sizeof(path), "%s.evt", log);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s.idx", log);
+    unlink(path);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int rv = 2;
+    if      (argc > 1 && strcmp(argv[1], "listen")  == 0) { rv = cmd_listen(argc, argv);  }
+    else if (argc > 1 && strcmp(argv[1], "loadgen") == 0) { rv = cmd_loadgen(argc, argv); }
+    else if (argc > 1 && strcmp(argv[1], "bench")   == 0) { rv = cmd_bench(argc, argv);   }
+
+    if (rv == 2)
+    {
+        fprintf(stderr, "usage: %s listen <port> <log> [-v]\n"
+                        "       %s loadgen <host> <port> <events/s> <seconds> [batch]\n"
+                        "       %s bench [seconds] [batch]\n", argv[0], argv[0], argv[0]);
+    }
+    return rv;
+}
@@ -1,4 +1,5 @@
 import sdi
+import struct
 
 class Pulsegen :
     NCHAN = 4
@@ -6,31 +7,70 @@ class Pulsegen :
     def trig(self) :
         return self.query('*TRG')
 
+    def abort(self) :
+        return self.query(':ABORt')
+
     def set_pulse(self, chan=1, delay=0.04, width=0.005, period=0.02, cycles=3, invert=0) :
         msgs = [':PULS%d:' % chan + s for s in ['DEL %f' % delay, 'WID %f' % width, 'PER %f' % period, 'CYC %d' % cycles, 'INV %d' % invert]]
         max_len = max([len(msg) for msg in my_msgs])
         for msg in msgs :
             print(msg.ljust(max_len) + ' ' + self.query(msg).strip())
 
+    def set_list(self, chan=1, ticks=[0, 1000, 3000, 3500]) :
+        data = struct.pack('<%dI' % len(ticks), *ticks)
+        size = str(len(data))
+        for msg in [':PULS%d:LIST #%d%s%s' % (chan, len(size), size, data), ':PULS%d:MOD LIST' % chan] :
+            print(msg.split('#')[0] + ' ' + self.query(msg).strip())
+
+    def commit(self) :
+        return self.query(':CONFigure:COMMit')
+
+    def set_auto(self, auto=1) :
+        return self.query(':CONFigure:AUTO %d' % auto)
+
+    def store_slot(self, slot=1) :
+        return self.query(':SEQuence:STORe %d' % slot)
+
+    def set_seq(self, length=0, index=1) :
+        for msg in [':SEQuence:LENgth %d' % length, ':SEQuence:INDex %d' % index] if length > 0 else [':SEQuence:LENgth 0'] :
+            print(msg + ' ' + self.query(msg).strip())
+
+    def dump_conf(self) :
+        self.dump([':CONFigure:' + s for s in ['AUTO', 'PENDing']])
+
+    def dump_seq(self) :
+        self.dump([':SEQuence:' + s for s in ['LENgth', 'INDex']])
+
+    def dump_diag(self) :
+        self.dump([':DIAGnostic:LATency' + s for s in ['', ':HISTogram', ':AUTO', ':OFFSet']])
+
     def dump_trig(self) :
-        self.dump([':TRIGger:' + s for s in ['EDGE', 'ARMed', 'READY', 'REARM', 'COUNt']])
+        self.dump([':TRIGger:' + s for s in ['EDGE', 'ARMed', 'READY', 'BUSY', 'REARM', 'COUNt']])
 
     def dump_clock(self) :
-        self.dump([':CLOCK:' + s for s in ['SRC', 'EDGE', 'FREQuency', 'FREQuency:MEASure', 'FREQuency:INTernal', 'FREQuency:EXTernal']])
+        self.dump([':CLOCK:' + s for s in ['SRC', 'EDGE', 'FREQuency', 'FREQuency:MEASure', 'FREQuency:MEASure:GATE', 'FREQuency:MEASure:ADEV', 'FREQuency:INTernal', 'FREQuency:EXTernal']])
 
     def dump_pulse(self, chan=1) :
-        self.dump([':PULSe%d:' % chan + s for s in ['DELay', 'WIDth', 'PERiod', 'CYCles', 'VALid', 'INVert']])
+        self.dump([':PULSe%d:' % chan + s for s in ['DELay', 'WIDth', 'PERiod', 'CYCles', 'VALid', 'ERRor', 'INVert', 'DRIVe', 'MODe', 'LIST:COUNt']])
 
     def dump_all(self, short=False) :
         print('device info:')
         self.dump(['*IDN'])
         print('trigger config:')
         self.dump_trig()
+        print('trigger latency:')
+        self.dump_diag()
         print('clock config:')
         self.dump_clock()
+        print('commit config:')
+        self.dump_conf()
+        print('sequencer config:')
+        self.dump_seq()
         print('pulse config:')
         for chan in range(1, self.NCHAN + 1) :
             self.dump_pulse(chan=chan)
+        print('serial config:')
+        self.dump_serial()
         print('network config:')
         self.dump_lan()
 
@@ -24,18 +24,36 @@ class SDI :
         for msg in my_msgs :
             print('  ' + msg.ljust(max_len) + ' ' + self.query(msg).strip())
 
+    def dump_serial(self) :
+        self.dump([':SYSTem:COMMunicate:SERial:BAUD'])
+
     def dump_lan(self) :
         self.dump([':SYSTem:COMMunicate:LAN:' + s for s in ['MODe', 'MAC', 'IP', 'GATEway', 'SUBnet', 'IP:STATic', 'GATEway:STATic', 'SUBnet:STATic']])
 
 class SDISerial(SDI, serial.Serial) :
-    def __init__(self, port, timeout=1, shorten=False) :
-        serial.Serial.__init__(self, port=port, timeout=timeout)
+    def __init__(self, port, timeout=1, shorten=False, baudrate=9600) :
+        serial.Serial.__init__(self, port=port, timeout=timeout, baudrate=baudrate)
         SDI.__init__(self, shorten)
 
     def query(self, msg) :
         self.write(msg + '\n')
         return self.readline()
 
+    def set_baud(self, baud) :
+        reply = self.query(':SYSTem:COMMunicate:SERial:BAUD %d' % baud)
+        self.baudrate = baud  # the device switches right after its reply
+        return reply
+
+    def query_block(self, msg) :
+        self.write(msg + '\n')
+        head = self.read(2)
+        if head[0] != '#' :  # error message instead of block
+            self.readline()
+            return None
+        data = self.read(int(self.read(int(head[1]))))
+        self.readline()
+        return data
+
 class SDISocket(SDI, socket.socket) :
     def __init__(self, ip_addr, port=18, timeout=1, shorten=False) :
         socket.socket.__init__(self, socket.AF_INET, socket.SOCK_STREAM)
@@ -50,3 +68,18 @@ class SDISocket(SDI, socket.socket) :
             reply += self.recv(512)
             if reply.endswith('\r') or reply.endswith('\n') : break
         return reply
+
+    def recv_exact(self, size) :
+        data = ''
+        while len(data) < size : data += self.recv(size - len(data))
+        return data
+
+    def query_block(self, msg) :
+        self.sendall(msg + '\n')
+        head = self.recv_exact(2)
+        if head[0] != '#' :  # error message instead of block
+            while not (head.endswith('\r') or head.endswith('\n')) : head += self.recv(512)
+            return None
+        data = self.recv_exact(int(self.recv_exact(int(head[1]))))
+        self.recv_exact(2)  # EOL
+        return data
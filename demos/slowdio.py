@@ -12,6 +12,8 @@ class SlowDIO :
         print('dio config:')
         for chan in range(1, self.NCHAN + 1) :
             self.dump_dio(chan=chan)
+        print('serial config:')
+        self.dump_serial()
         print('network config:')
         self.dump_lan()
 
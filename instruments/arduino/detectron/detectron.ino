@@ -1,6 +1,16 @@
 #define LAN
 #define MSGLEN 64  // includes null-terminator
+#define OUTLEN 64  // reply output buffer, written out at end of line or when full
 #define PORT   18
+#define NEVENT 64  // capture ring buffer entries, power of two
+#define NBATCH 32  // max events per batched UDP datagram
+#define NDATA  64  // recorder entries, 6 bytes each
+#define NSUB   8   // rate meter sub-windows per window
+#define NHIST  14  // interval histogram bins, factor 4 apart
+#define BATCH_HDR 9  // uint32 sequence number, uint32 timestamp base, byte count
+#define FRAME_SYNC 0x7E  // starts and ends a binary serial event frame
+#define FRAME_ESC  0x7D  // followed by the escaped byte XOR 0x20
+#define FRAME_LEN  7     // byte old, byte new, uint32 timestamp, byte checksum
 
 #include <avr/wdt.h>
 #include "eeprom/shared.h"  // includes EEPROM.h
@@ -9,8 +19,12 @@
 
 const unsigned long conf_commit           = 0x1234abc;  // edit to match current commit before compile/download!
 const unsigned int  conf_dhcp_cycles      = 1000;
-const byte          conf_y_all            = 0x7F;       // binary 01111111, number of ones must match NCHAN!
-const byte          conf_input_pin[NCHAN] = {9, 8, 7, 6, 5, 3, 2};
+const byte          conf_y_all            = 0xFF;       // binary 11111111, number of ones must match NCHAN!
+const byte          conf_input_pin[NCHAN] = {9, 8, 7, 6, 5, 3, 2, 12};  // pins without external or pin-change interrupt are polled
+byte *              conf_input_port[NCHAN] = {&PINB, &PINB, &PINE, &PIND, &PINC, &PIND, &PIND, &PIND};  // board-dependent, must match input_pin
+const byte          conf_input_mask[NCHAN] = {1 << 5, 1 << 4, 1 << 6, 1 << 7, 1 << 6, 1 << 0, 1 << 1, 1 << 6};  // board-dependent, must match input_pin
+const byte          conf_counter_pin      = 12;         // board-dependent, Timer1 external clock input (T1), see testing/arduino/timer1
+const long          conf_event_freq       = 2000000;    // board-dependent, Timer3 frequency with prescaler set to /8
 
 // SCPI commands:
 //   *IDN?            model and version
@@ -20,12 +34,27 @@ const byte          conf_input_pin[NCHAN] = {9, 8, 7, 6, 5, 3, 2};
 //   *RST             reset to default settings (LAN excluded)
 //   :SYSTem:REBoot   reboot the device
 //   :INput<n>:VALue  current state, with inversion applied
+//   :INput<n>:RATE   events per s over the last :INput:WINDow
+//   :INput:RATE      same for all inputs, comma-separated
+//   :INput<n>:HISTogram  counts of intervals between consecutive events, comma-separated (see shared.h)
+//   :INput<n>:HISTogram:CLEar  reset the histogram
+//   :INput<n>:FREQuency        frequency in Hz over the last :INput:GATE, MODe COUNTER only
+//   :COINcidence<g>:COUNt      coincidences of group g since reboot or the last change of its MASK
+//   :EVENt:OVERflow  events lost because the capture ring buffer was full, since reboot
+//   :DATA:FETCh? <n> oldest n (default all) recorded events as binary block of 6-byte records, which are then removed
+//   :DATA:CLEar      remove all recorded events and reset :DATA:OVERflow
 
 // persistent SCPI settings:
 SCPI scpi;
 
 // runtime SCPI variables (read-only except where noted):
-long     scpi_input_count[NCHAN];  // :INput<n>:COUNt                  hardware events detected since reboot
+long     scpi_input_count[NCHAN];  // :INput<n>:COUNt                  hardware events detected since reboot (see counter_read() for MODe COUNTER)
+volatile long scpi_input_rejected[NCHAN]; // :INput<n>:REJected       transitions ignored by the hold-off filter since reboot
+long long scpi_input_freq;         // :INput<n>:FREQuency              in mHz, for the input in MODe COUNTER
+bool     scpi_data_enable;         // :DATA:ENable                     record events (read/write)
+int      scpi_data_count;          // :DATA:COUNt                      events recorded and not yet fetched
+long     scpi_data_overflow;       // :DATA:OVERflow                   events not recorded because the recorder was full
+long     scpi_coinc_count[NCOINC]; // :COINcidence<g>:COUNt            coincidences detected
 #ifdef LAN
 byte     scpi_lan_mode;            // :SYSTem:COMMunicate:LAN:MODe     actual mode (writes go to scpi_lan.mode)
 #endif
@@ -33,9 +62,68 @@ uint32_t scpi_lan_ip;              // :SYSTem:COMMunicate:LAN:IP       current i
 uint32_t scpi_lan_gateway;         // :SYSTem:COMMunicate:LAN:GATEway  current gateway address
 uint32_t scpi_lan_subnet;          // :SYSTem:COMMunicate:LAN:SUBnet   current subnet mask
 
+struct EVENT  // one input transition, as captured
+{
+    unsigned long t;  // Timer3 ticks, extended to 32 bits
+    byte          y_old;
+    byte          y_new;
+};
+
 byte mask_rising;
 byte mask_falling;
-byte y_old;
+byte mask_invert;
+byte mask_filter;   // inputs with a hold-off time
+byte mask_capture;  // inputs sampled into events, i.e. all but the one in MODe COUNTER
+
+// hold-off filter, applied in capture() so rejected transitions never reach the ring buffer, producer only:
+volatile byte          y_raw;               // inputs as sampled by the last capture(), unfiltered
+volatile unsigned long filt_t     [NCHAN];  // timestamp of the last accepted transition
+volatile unsigned long filt_ticks [NCHAN];  // :INput<n>:FILTer in ticks
+
+// input snapshot, all ports read back to back:
+volatile byte *port_addr [NCHAN];  // distinct entries of conf_input_port, volatile so repeated snapshots are never merged
+byte           port_idx  [NCHAN];  // index into port_addr for each input
+byte           N_port;
+
+// capture ring buffer, single producer (pin interrupts, or loop() with interrupts disabled) and single consumer (loop()):
+volatile EVENT         ev_ring[NEVENT];
+volatile byte          ev_head;      // next entry to write, producer only
+volatile byte          ev_tail;      // next entry to read, consumer only
+volatile byte          y_old;        // inputs as of the last captured event (filtered), producer only
+volatile long          ev_overflow;  // :EVENt:OVERflow
+volatile unsigned int  t3_ovf;       // Timer3 overflows, i.e. upper 16 bits of event timestamps
+
+// batched UDP datagram, records are (y_old, y_new, uint16 ticks since previous event), all little-endian:
+byte          batch_buf[BATCH_HDR + 4*NBATCH];
+byte          batch_n;
+unsigned long batch_seq;
+unsigned long batch_t;   // timestamp of last event in batch
+unsigned long batch_ms;  // millis() at first event in batch
+
+// rate meter, events per sub-window, rate_cur is the one being filled since rate_ms:
+unsigned int  rate_count[NSUB][NCHAN];  // saturating
+byte          rate_cur;
+byte          rate_full;  // completed sub-windows, max NSUB - 1
+unsigned long rate_ms;
+unsigned long rate_sub_ms;
+
+// hardware counter (Timer1 clocked by conf_counter_pin), gate boundaries by Timer3:
+volatile unsigned long t1_ovf;         // Timer1 overflows since the counter was started, i.e. upper 32 bits of the count
+unsigned long long     freq_c_prev;    // count at the last gate boundary
+unsigned long          freq_t_prev;    // Timer3 ticks at the last gate boundary
+unsigned long          freq_ms;        // millis() at the last gate boundary
+bool                   counter_on;
+
+// previous counted event per input, for interval histograms and coincidences:
+unsigned long last_t[NCHAN];
+byte          last_seen;  // inputs with a previous event
+
+unsigned int  hist_count[NCHAN][NHIST];  // saturating
+byte          coinc_armed[NCOINC];       // group members with an event since the group last fired
+
+// event recorder, oldest entry at data_tail:
+EVENT data_buf[NDATA];
+int   data_tail;
 
 #ifdef LAN
 EthernetServer server(PORT);
@@ -49,16 +137,45 @@ void setup()
 
     EEPROM.get(EPA_SCPI, scpi);
 
+    N_port = 0;
+    for (int n = 0; n < NCHAN; n++)
+    {
+        byte p = 0;
+        while (p < N_port && port_addr[p] != conf_input_port[n]) { p++; }
+        if (p == N_port) { port_addr[N_port++] = conf_input_port[n]; }
+        port_idx[n] = p;
+    }
+
     update_masks();
 
+    TCCR3A = 0x0;          // COM3A1=0 COM3A0=0 COM3B1=0 COM3B0=0 COM3C1=0 COM3C0=0 WGM31=0 WGM30=0
+    TCCR3B = 0x2;          // ICNC3=0  ICES3=0  n/a=0    WGM33=0  WGM32=0  CS32=0   CS31=1  CS30=0  (normal, /8)
+    TIMSK3 = bit(TOIE3);   // overflow interrupt extends TCNT3 to 32 bits
+
     for (int n = 0; n < NCHAN; n++)
     {
         update_input(n);
-        scpi_input_count[n] = 0;
+        scpi_input_count[n]    = 0;
+        scpi_input_rejected[n] = 0;
+
+        const byte pin = conf_input_pin[n];
+        if (digitalPinToInterrupt(pin) != NOT_AN_INTERRUPT) { attachInterrupt(digitalPinToInterrupt(pin), capture, CHANGE); }
+        else if (digitalPinToPCICR(pin))
+        {
+            *digitalPinToPCICR(pin) |= bit(digitalPinToPCICRbit(pin));
+            *digitalPinToPCMSK(pin) |= bit(digitalPinToPCMSKbit(pin));
+        }
     }
-    y_old = pack_inputs();
+    ev_overflow = 0;
+    update_capture();
+    data_clear();
+    scpi_data_enable = 0;
+    update_rate();
+    for (int n = 0; n < NCHAN; n++) { hist_clear(n); }
+    last_seen = 0;
+    for (int g = 0; g < NCOINC; g++) { coinc_clear(g); }
 
-    Serial.begin(9600);
+    update_baud();
 
 #ifdef LAN
     SCPI_LAN scpi_lan;
@@ -87,19 +204,17 @@ void loop()
     if (Serial.available() > 0)
     {
         lan = 0;  // receive/send via Serial
-        char msg[MSGLEN];
-        if (recv_msg(msg)) { parse_msg(msg); }
+        if (recv_msg(line_serial)) { parse_compound(line_serial.msg, parse_msg); send_flush(); }  // one message per loop
     }
 
 #ifdef LAN
     if (scpi_lan_mode != LAN_OFF)
     {
-        client = server.available();
+        client = recv_client(server);
         if (client)
         {
             lan = 1;  // receive/send via client
-            char msg[MSGLEN];
-            if (recv_msg(msg)) { parse_msg(msg); }
+            if (recv_msg(line_lan)) { parse_compound(line_lan.msg, parse_msg); send_flush(); }
         }
     }
 
@@ -115,48 +230,322 @@ void loop()
     }
 #endif
 
-    byte y_new   = pack_inputs();
-    byte y_event = (~y_old &  y_new & mask_rising) |
-                   ( y_old & ~y_new & mask_falling);
-    if (y_event)
+    noInterrupts();
+    capture();  // poll inputs without pin interrupt, and those left at a different level when their hold-off expired
+    interrupts();
+
+    EVENT e;
+    while (pop_event(e)) { handle_event(e); }
+    rate_rotate();
+    if (counter_on && millis() - freq_ms >= (unsigned long)scpi.input_gate / 1000) { update_freq(); }
+    if (batch_n > 0 && millis() - batch_ms >= (unsigned long)scpi.output_udp_latency / 1000) { batch_flush(); }
+
+    delay(1);
+}
+
+ISR(PCINT0_vect)
+{
+    capture();
+}
+
+ISR(TIMER1_OVF_vect)
+{
+    t1_ovf++;
+}
+
+ISR(TIMER3_OVF_vect)
+{
+    t3_ovf++;
+}
+
+void capture()  // producer, call with interrupts disabled, O(NCHAN) per call however noisy the inputs
+{
+    const unsigned int c = TCNT3;  // as early as possible
+    byte y_new = pack_inputs() & mask_capture;
+    const byte dy_raw = (y_new ^ y_raw) & mask_filter;  // transitions of filtered inputs since the last call
+    y_raw = y_new;
+    if (y_new == y_old && !dy_raw) { return; }  // e.g. a disabled pin-change or the counter input
+
+    const unsigned long t = extend_tcnt3(c);
+    const byte dy = ((y_new ^ y_old) & mask_filter) | dy_raw;
+    if (dy)
     {
-        send_event(y_old, y_new);
-        update_counts(y_event);
+        byte b = 0x1;
+        for (byte n = 0; n < NCHAN; n++, b <<= 1)
+        {
+            if (!(dy & b)) { continue; }
+            if (t - filt_t[n] < filt_ticks[n])  // within hold-off, keep the level of the last accepted transition
+            {
+                y_new = (y_new & ~b) | (y_old & b);
+                if (dy_raw & b) { scpi_input_rejected[n]++; }
+            }
+            else if ((y_new ^ y_old) & b) { filt_t[n] = t; }
+        }
+    }
+    if (y_new == y_old) { return; }  // a bounce already undone, or held off
+
+    const byte head = (ev_head + 1) & (NEVENT - 1);
+    if (head == ev_tail) { ev_overflow++; }
+    else
+    {
+        ev_ring[ev_head].t     = t;
+        ev_ring[ev_head].y_old = y_old;
+        ev_ring[ev_head].y_new = y_new;
+        ev_head = head;
     }
     y_old = y_new;
+}
 
-    delay(1);
+bool pop_event(EVENT &e)  // consumer
+{
+    const byte tail = ev_tail;
+    if (tail == ev_head) { return 0; }
+
+    e.t     = ev_ring[tail].t;
+    e.y_old = ev_ring[tail].y_old;
+    e.y_new = ev_ring[tail].y_new;
+    ev_tail = (tail + 1) & (NEVENT - 1);  // release entry only after it has been copied
+    return 1;
+}
+
+void handle_event(const EVENT &e)
+{
+    byte y_event = (~e.y_old &  e.y_new & mask_rising) |
+                   ( e.y_old & ~e.y_new & mask_falling);
+    if (y_event)
+    {
+        update_counts(y_event, e.t);
+        if (update_coinc(y_event, e.t) || !scpi.coinc_only)
+        {
+            send_event(e.y_old, e.y_new, e.t);
+            if (scpi_data_enable) { data_record(e); }
+        }
+    }
+}
+
+unsigned long event_time()
+{
+    noInterrupts();
+    const unsigned long t = extend_tcnt3(TCNT3);
+    interrupts();
+    return t;
+}
+
+unsigned long extend_tcnt3(const unsigned int c)  // call with interrupts disabled, c must be read from TCNT3 shortly before
+{
+    unsigned int ovf = t3_ovf;
+    if ((TIFR3 & bit(TOV3)) && c < 0x8000) { ovf++; }  // wrapped, but TIMER3_OVF not yet serviced
+    return ((unsigned long)ovf << 16) | c;
+}
+
+unsigned long long counter_read()  // count since the counter was started, 48 bits
+{
+    noInterrupts();
+    const unsigned int c = TCNT1;
+    unsigned long ovf = t1_ovf;
+    if ((TIFR1 & bit(TOV1)) && c < 0x8000) { ovf++; }  // wrapped, but TIMER1_OVF not yet serviced
+    interrupts();
+    return ((unsigned long long)ovf << 16) | c;
 }
 
 bool read_input(const int n)
 {
-    bool x_raw = digitalRead(conf_input_pin[n]);
-    return scpi.input_invert[n] ? !x_raw : x_raw;
+    return (pack_inputs() >> n) & 0x1;
 }
 
-byte pack_inputs()
+byte pack_inputs()  // all inputs at (nearly) the same instant, with inversion applied
 {
+    byte port_val[NCHAN];
+    for (byte p = 0; p < N_port; p++) { port_val[p] = *port_addr[p]; }  // a few cycles apart, nothing else in between
+
     byte y = 0;
-    for (int n = 0; n < NCHAN; n++) { y |= read_input(n) << n; }
-    return y;
+    byte b = 0x1;
+    for (byte n = 0; n < NCHAN; n++, b <<= 1) { if (port_val[port_idx[n]] & conf_input_mask[n]) { y |= b; } }
+    return y ^ mask_invert;
 }
 
-void send_event(const byte y1, const byte y2)
+void send_event(const byte y1, const byte y2, const unsigned long t)
 {
-    if (scpi.output_serial)
+    if (scpi.output_serial && scpi.output_serial_format == FORMAT_TEXT)
     {
         Serial.write(y1);
         Serial.write(y2);
         Serial.println();
     }
+    else if (scpi.output_serial) { send_frame(y1, y2, t); }
 
-    if (scpi.output_udp)
+    if (scpi.output_udp && scpi.output_udp_batch == 0)  // one datagram per event
     {
         udp.beginPacket(scpi.output_udp_dest, scpi.output_udp_port);
         udp.write(y1);
         udp.write(y2);
         udp.endPacket();
     }
+    else if (scpi.output_udp)
+    {
+        if (batch_n > 0 && t - batch_t > 0xFFFF) { batch_flush(); }  // delta would not fit
+        if (batch_n == 0)
+        {
+            put_u32(batch_buf + 4, t);  // timestamp base
+            batch_t  = t;
+            batch_ms = millis();
+        }
+
+        byte *rec = batch_buf + BATCH_HDR + 4*batch_n;
+        rec[0] = y1;
+        rec[1] = y2;
+        rec[2] = (t - batch_t) & 0xFF;
+        rec[3] = (t - batch_t) >> 8;
+        batch_t = t;
+
+        if (++batch_n >= scpi.output_udp_batch) { batch_flush(); }
+    }
+}
+
+void send_frame(const byte y1, const byte y2, const unsigned long t)
+{
+    byte raw[FRAME_LEN];
+    raw[0] = y1;
+    raw[1] = y2;
+    put_u32(raw + 2, t);
+
+    byte sum = 0;
+    for (int j = 0; j < FRAME_LEN - 1; j++) { sum += raw[j]; }
+    raw[FRAME_LEN - 1] = -sum;  // all bytes add up to zero
+
+    byte buf[2 + 2*FRAME_LEN];
+    int  len = 0;
+    buf[len++] = FRAME_SYNC;
+    for (int j = 0; j < FRAME_LEN; j++)
+    {
+        const byte b = raw[j];
+        if (b == FRAME_SYNC || b == FRAME_ESC || b == '\n' || b == '\r')  // never mistaken for a frame boundary or a line end
+        {
+            buf[len++] = FRAME_ESC;
+            buf[len++] = b ^ 0x20;
+        }
+        else { buf[len++] = b; }
+    }
+    buf[len++] = FRAME_SYNC;
+    Serial.write(buf, len);  // one write, i.e. one USB packet
+}
+
+void batch_flush()
+{
+    if (batch_n == 0) { return; }
+
+    put_u32(batch_buf, batch_seq++);
+    batch_buf[8] = batch_n;
+
+    udp.beginPacket(scpi.output_udp_dest, scpi.output_udp_port);
+    udp.write(batch_buf, BATCH_HDR + 4*batch_n);
+    udp.endPacket();
+    batch_n = 0;
+}
+
+void put_u32(byte *dest, const unsigned long x)
+{
+    for (int j = 0; j < 4; j++) { dest[j] = x >> (8*j); }
+}
+
+void data_record(const EVENT &e)
+{
+    if (scpi_data_count == NDATA) { scpi_data_overflow++; return; }  // keep the oldest
+
+    data_buf[(data_tail + scpi_data_count) % NDATA] = e;
+    scpi_data_count++;
+}
+
+void data_clear()
+{
+    data_tail          = 0;
+    scpi_data_count    = 0;
+    scpi_data_overflow = 0;
+}
+
+void send_data(const long m)  // oldest m events, then removed
+{
+    send_block(6*m);
+    for (long j = 0; j < m; j++)
+    {
+        const EVENT &e = data_buf[data_tail];
+        for (int k = 0; k < 32; k += 8) { send_byte(e.t >> k); }
+        send_byte(e.y_old);
+        send_byte(e.y_new);
+
+        data_tail = (data_tail + 1) % NDATA;
+        scpi_data_count--;
+    }
+    send_str("");
+}
+
+void rate_rotate()
+{
+    if (rate_sub_ms == 0) { return; }  // not yet started, the loop below would never end
+
+    while (millis() - rate_ms >= rate_sub_ms)
+    {
+        rate_ms += rate_sub_ms;
+        rate_cur = (rate_cur + 1) % NSUB;
+        for (int n = 0; n < NCHAN; n++) { rate_count[rate_cur][n] = 0; }
+        if (rate_full < NSUB - 1) { rate_full++; }
+    }
+}
+
+long rate_milli(const int n)  // events per 1000 s over the window, including the sub-window being filled
+{
+    rate_rotate();
+
+    unsigned long sum = 0;
+    for (int j = 0; j < NSUB; j++) { sum += rate_count[j][n]; }
+    const unsigned long ms = rate_full*rate_sub_ms + (millis() - rate_ms);
+    return ms > 0 ? (long long)sum * 1000000 / ms : 0;
+}
+
+void hist_add(const int n, const unsigned long dt)
+{
+    byte j = 0;  // bin 0 below 2^6 ticks, bin j from 2^(2j+4) to 2^(2j+6) ticks
+    for (unsigned long x = dt >> 6; x > 0 && j < NHIST - 1; x >>= 2) { j++; }
+    if (hist_count[n][j] < 0xFFFF) { hist_count[n][j]++; }
+}
+
+void hist_clear(const int n)
+{
+    for (int j = 0; j < NHIST; j++) { hist_count[n][j] = 0; }
+}
+
+void send_hist(const int n)
+{
+    for (int j = 0; j < NHIST - 1; j++)
+    {
+        send_int(hist_count[n][j], NOEOL);
+        send_str(",",              NOEOL);
+    }
+    send_int(hist_count[n][NHIST - 1]);
+}
+
+void send_mask(const byte mask)  // comma-separated input numbers
+{
+    if (mask == 0) { send_str("NONE"); return; }
+
+    byte rest = mask;
+    for (int n = 0; n < NCHAN; n++)
+    {
+        if (!((mask >> n) & 0x1)) { continue; }
+        rest &= ~(0x1 << n);
+        send_int(n + 1, rest ? NOEOL : EOL);
+        if (rest) { send_str(",", NOEOL); }
+    }
+}
+
+void send_rates()
+{
+    for (int n = 0; n < NCHAN - 1; n++)
+    {
+        send_milli(rate_milli(n), NOEOL);
+        send_str(",",             NOEOL);
+    }
+    send_milli(rate_milli(NCHAN - 1));
 }
 
 void sim_events()
@@ -165,7 +554,7 @@ void sim_events()
     {
         if (scpi.input_mode[n] & RISING)
         {
-            send_event(0, conf_y_all);
+            send_event(0, conf_y_all, event_time());
             break;
         }
     }
@@ -174,7 +563,7 @@ void sim_events()
     {
         if (scpi.input_mode[n] & FALLING)
         {
-            send_event(conf_y_all, 0);
+            send_event(conf_y_all, 0, event_time());
             break;
         }
     }
@@ -186,22 +575,144 @@ void update_masks()
 {
     mask_rising  = 0;
     mask_falling = 0;
+    mask_invert  = 0;
+    mask_filter  = 0;
+    mask_capture = 0;
 
     for (int n = 0; n < NCHAN; n++)
     {
-        if (scpi.input_mode[n] == RISING  || scpi.input_mode[n] == CHANGE) { mask_rising  |= 0x1 << n; }
+        if (scpi.input_mode[n] == RISING  || scpi.input_mode[n] == CHANGE) { mask_rising  |= 0x1 << n; }  // COUNTER is in neither
         if (scpi.input_mode[n] == FALLING || scpi.input_mode[n] == CHANGE) { mask_falling |= 0x1 << n; }
+        if (scpi.input_invert[n])                                          { mask_invert  |= 0x1 << n; }
+        if (scpi.input_filter[n] > 0)                                      { mask_filter  |= 0x1 << n; }
+        if (scpi.input_mode[n] != COUNTER)                                 { mask_capture |= 0x1 << n; }  // counted by Timer1 alone
+
+        noInterrupts();
+        filt_ticks[n] = scpi.input_filter[n] * (conf_event_freq / 1000000);
+        interrupts();
     }
 }
 
 void update_input(const int n)
 {
     pinMode(conf_input_pin[n], scpi.input_pullup[n] ? INPUT_PULLUP : INPUT);
+    if (conf_input_pin[n] == conf_counter_pin) { update_counter(n); }
+}
+
+void update_counter(const int n)  // (re)start or stop the hardware counter
+{
+    counter_on = (scpi.input_mode[n] == COUNTER);
+
+    noInterrupts();
+    TCCR1B = 0x0;            // stop
+    TCCR1A = 0x0;            // COM1A1=0 COM1A0=0 COM1B1=0 COM1B0=0 COM1C1=0 COM1C0=0 WGM11=0 WGM10=0
+    TCNT1  = 0;
+    t1_ovf = 0;
+    TIFR1  = bit(TOV1);      // clear stale overflow
+    TIMSK1 = counter_on ? bit(TOIE1) : 0;
+    if (counter_on) { TCCR1B = scpi.input_invert[n] ? 0x6 : 0x7; }  // CS12=1 CS11=1 CS10=0/1 (external clock on T1, falling/rising)
+    freq_t_prev = extend_tcnt3(TCNT3);
+    interrupts();
+
+    freq_c_prev     = 0;
+    freq_ms         = millis();
+    scpi_input_freq = 0;
+}
+
+void update_freq()  // gate boundary, counter and Timer3 are read together
+{
+    noInterrupts();
+    const unsigned int  c  = TCNT1;
+    const unsigned long t  = extend_tcnt3(TCNT3);
+    unsigned long       ovf = t1_ovf;
+    if ((TIFR1 & bit(TOV1)) && c < 0x8000) { ovf++; }
+    interrupts();
+
+    const unsigned long long k  = ((unsigned long long)ovf << 16) | c;
+    const unsigned long      dt = t - freq_t_prev;
+    if (dt > 0) { scpi_input_freq = ((k - freq_c_prev) * conf_event_freq * 1000 + dt / 2) / dt; }
+
+    freq_c_prev = k;
+    freq_t_prev = t;
+    freq_ms     = millis();
+}
+
+void update_capture()  // resync after input settings change, events still in the ring are dropped
+{
+    noInterrupts();
+    ev_tail = ev_head;
+    y_old   = pack_inputs() & mask_capture;
+    y_raw   = y_old;
+    const unsigned long t = extend_tcnt3(TCNT3);
+    for (int n = 0; n < NCHAN; n++) { filt_t[n] = t - filt_ticks[n]; }  // no hold-off pending
+    interrupts();
+}
+
+void update_counts(const byte y_event, const unsigned long t)  // O(1) per input, called for every event
+{
+    for (int n = 0; n < NCHAN; n++)
+    {
+        if (!((y_event >> n) & 0x1)) { continue; }
+
+        scpi_input_count[n]++;
+        if (rate_count[rate_cur][n] < 0xFFFF) { rate_count[rate_cur][n]++; }
+        if ((last_seen >> n) & 0x1)           { hist_add(n, t - last_t[n]); }
+        last_t[n]  = t;
+        last_seen |= 0x1 << n;
+    }
+}
+
+byte update_coinc(const byte y_event, const unsigned long t)  // groups completed by this event, call after update_counts()
+{
+    const unsigned long window = scpi.coinc_window * (conf_event_freq / 1000000);  // in ticks
+    byte g_event = 0;
+
+    for (int g = 0; g < NCOINC; g++)
+    {
+        const byte mask = scpi.coinc_mask[g];
+        if (!(y_event & mask)) { continue; }  // also skips disabled groups
+
+        coinc_armed[g] |= y_event & mask;
+        for (int n = 0; n < NCHAN; n++)
+        {
+            if (((coinc_armed[g] >> n) & 0x1) && t - last_t[n] > window) { coinc_armed[g] &= ~(0x1 << n); }  // too old
+        }
+        if (coinc_armed[g] == mask)
+        {
+            scpi_coinc_count[g]++;
+            coinc_armed[g] = 0;  // each member needs a new event for the next one
+            g_event |= 0x1 << g;
+        }
+    }
+    return g_event;
+}
+
+void coinc_clear(const int g)
+{
+    scpi_coinc_count[g] = 0;
+    coinc_armed[g]      = 0;
+}
+
+void update_rate()  // restart the rate meter, e.g. after the window changed
+{
+    if (scpi.input_window < 1000L*NSUB || scpi.input_window > 60000000) { scpi.input_window = DEF_INPUT_WINDOW; }  // e.g. EEPROM not yet initialized
+
+    for (int j = 0; j < NSUB; j++) { for (int n = 0; n < NCHAN; n++) { rate_count[j][n] = 0; } }
+    rate_cur    = 0;
+    rate_full   = 0;
+    rate_ms     = millis();
+    rate_sub_ms = scpi.input_window / 1000 / NSUB;
 }
 
-void update_counts(const byte y_event)
+void update_baud()
 {
-    for (int n = 0; n < NCHAN; n++) { if ((y_event >> n) & 0x1) { scpi_input_count[n]++; } }
+    long baud;
+    EEPROM.get(EPA_SERIAL_BAUD, baud);
+    if (baud < 300 || baud > 2000000) { baud = 9600; }  // e.g. EEPROM not yet initialized
+
+    Serial.flush();  // pending output at the old rate
+    Serial.end();
+    Serial.begin(baud);
 }
 
 void update_lan()
@@ -224,194 +735,456 @@ void update_lan()
 
 void parse_msg(const char *msg)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"*IDN", "*TRG", "*SAV", "*RCL", "*RST", ":INput#", ":COINcidence#", ":OUTput", ":EVENt", ":DATA", ":SYSTem"};
+    enum                                       { K_IDN,  K_TRG,  K_SAV,  K_RCL,  K_RST,  K_IN,      K_COIN,          K_OUT,     K_EVEN,   K_DATA,  K_SYST };
     bool update = 0;
+    int n;
 
-    if (equal(msg, "*IDN?"))
-    {
-        unsigned long eeprom_commit;
-        EEPROM.get(EPA_COMMIT, eeprom_commit);
-
-        send_eps(EPA_IDN,       NOEOL);
-        send_str(" (PROG: ",    NOEOL);
-        send_hex(conf_commit,   NOEOL);
-        send_str(", EEPROM: ",  NOEOL);
-        send_hex(eeprom_commit, NOEOL);
-        send_str(")");
-    }
-    else if (equal(msg, "*TRG"))                   { send_str("OK"); sim_events();               } // reply first, so serial events do not get mixed in with the SCPI conversation
-    else if (equal(msg, "*SAV"))                   { EEPROM.put(EPA_SCPI, scpi); send_str("OK"); }
-    else if (equal(msg, "*RCL"))                   { EEPROM.get(EPA_SCPI, scpi); update = 1;     }
-    else if (equal(msg, "*RST"))                   { scpi_default(scpi);         update = 1;     }
-    else if (start(msg, ":IN", "put", "1:", rest)) { parse_input(0, rest);                       }
-    else if (start(msg, ":IN", "put", "2:", rest)) { parse_input(1, rest);                       }
-    else if (start(msg, ":IN", "put", "3:", rest)) { parse_input(2, rest);                       }
-    else if (start(msg, ":IN", "put", "4:", rest)) { parse_input(3, rest);                       }
-    else if (start(msg, ":IN", "put", "5:", rest)) { parse_input(4, rest);                       }
-    else if (start(msg, ":IN", "put", "6:", rest)) { parse_input(5, rest);                       }
-    else if (start(msg, ":IN", "put", "7:", rest)) { parse_input(6, rest);                       }
-    else if (start(msg, ":OUT", "put", ":", rest)) { parse_output(rest);                         }
-    else if (start(msg, ":SYST", "em", ":", rest)) { parse_system(rest);                         }
-    else                                           { send_eps(EPA_REPLY_INVALID_CMD);            }
+    switch (parse_key(msg, keys, n))
+    {
+        case K_IDN | QUERY:
+        {
+            unsigned long eeprom_commit;
+            EEPROM.get(EPA_COMMIT, eeprom_commit);
+
+            send_eps(EPA_IDN,       NOEOL);
+            send_str(" (PROG: ",    NOEOL);
+            send_hex(conf_commit,   NOEOL);
+            send_str(", EEPROM: ",  NOEOL);
+            send_hex(eeprom_commit, NOEOL);
+            send_str(")");
+            break;
+        }
+        case K_TRG | BARE: send_str("OK"); sim_events();               break;  // reply first, so serial events do not get mixed in with the SCPI conversation
+        case K_SAV | BARE: EEPROM.put(EPA_SCPI, scpi); send_str("OK"); break;
+        case K_RCL | BARE: EEPROM.get(EPA_SCPI, scpi); update = 1;     break;
+        case K_RST | BARE: scpi_default(scpi); update = 1;             break;
+        case K_IN  | NODE:
+            if      (n < 0)                    { parse_inputs(msg);                }  // :INput: without suffix
+            else if (n >= 1 && n <= NCHAN)     { parse_input(n - 1, msg);          }
+            else                               { send_eps(EPA_REPLY_INVALID_CMD); }
+            break;
+        case K_COIN | NODE:
+            if      (n < 0)                    { parse_coincs(msg);                }  // :COINcidence: without suffix
+            else if (n >= 1 && n <= NCOINC)    { parse_coinc(n - 1, msg);          }
+            else                               { send_eps(EPA_REPLY_INVALID_CMD); }
+            break;
+        case K_OUT  | NODE: parse_output(msg); break;
+        case K_EVEN | NODE: parse_event(msg);  break;
+        case K_DATA | NODE: parse_data(msg);   break;
+        case K_SYST | NODE: parse_system(msg); break;
+        default:            send_eps(EPA_REPLY_INVALID_CMD);
+    }
 
     if (update)
     {
         update_masks();
         for (int n = 0; n < NCHAN; n++) { update_input(n); }
-        y_old = pack_inputs();
+        update_capture();
+        update_rate();
+        for (int g = 0; g < NCOINC; g++) { coinc_clear(g); }
         send_str("OK");
     }
 }
 
 void parse_input(const int n, const char *msg)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"MODe", "PULLup", "INVert", "COUNt", "VALue", "RATE", "HISTogram", "FILTer", "REJected", "FREQuency"};
+    enum                                       { K_MOD,  K_PULL,   K_INV,    K_COUN,  K_VAL,   K_RATE, K_HIST,      K_FILT,   K_REJ,      K_FREQ };
     bool update = 0;
+    long tmp;
 
-    if (equal(msg, "MOD", "e", "?"))
+    switch (parse_key(msg, keys))
     {
-        send_str(scpi.input_mode[n] == RISING  ? "RISING"  :
-                 scpi.input_mode[n] == FALLING ? "FALLING" :
-                 scpi.input_mode[n] == CHANGE  ? "CHANGE"  :
-                                                 "OFF");
+        case K_MOD | QUERY:
+            send_str(scpi.input_mode[n] == RISING  ? "RISING"  :
+                     scpi.input_mode[n] == FALLING ? "FALLING" :
+                     scpi.input_mode[n] == CHANGE  ? "CHANGE"  :
+                     scpi.input_mode[n] == COUNTER ? "COUNTER" :
+                                                     "OFF");
+            break;
+        case K_MOD | SET:
+            if      (equal(msg, "OFF"))                            { scpi.input_mode[n] = 0;       update = 1; }
+            else if (equal(msg, "RIS", "ing"))                     { scpi.input_mode[n] = RISING;  update = 1; }
+            else if (equal(msg, "FALL", "ing"))                    { scpi.input_mode[n] = FALLING; update = 1; }
+            else if (equal(msg, "CHA", "nge"))                     { scpi.input_mode[n] = CHANGE;  update = 1; }
+            else if (equal(msg, "COUN", "ter"))
+            {
+                if (conf_input_pin[n] == conf_counter_pin)         { scpi.input_mode[n] = COUNTER; update = 1; }
+                else                                               { send_eps(EPA_REPLY_INVALID_ARG);          }
+            }
+            else                                                   { send_eps(EPA_REPLY_INVALID_ARG);          }
+            break;
+        case K_PULL | QUERY: send_hex(scpi.input_pullup[n]); break;
+        case K_PULL | SET:
+            if      (equal(msg, "1"))                              { scpi.input_pullup[n] = 1;     update = 1; }
+            else if (equal(msg, "0"))                              { scpi.input_pullup[n] = 0;     update = 1; }
+            else                                                   { send_eps(EPA_REPLY_INVALID_ARG);          }
+            break;
+        case K_INV | QUERY: send_hex(scpi.input_invert[n]); break;
+        case K_INV | SET:
+            if      (equal(msg, "1"))                              { scpi.input_invert[n] = 1;     update = 1; }
+            else if (equal(msg, "0"))                              { scpi.input_invert[n] = 0;     update = 1; }
+            else                                                   { send_eps(EPA_REPLY_INVALID_ARG);          }
+            break;
+        case K_COUN | QUERY:
+            if (scpi.input_mode[n] == COUNTER)                     { send_ull(counter_read());                 }
+            else                                                   { send_int(scpi_input_count[n]);            }
+            break;
+        case K_COUN | SET:   send_eps(EPA_REPLY_READONLY);      break;
+        case K_VAL  | QUERY: send_hex(read_input(n));           break;
+        case K_VAL  | SET:   send_eps(EPA_REPLY_READONLY);      break;
+        case K_RATE | QUERY: send_milli(rate_milli(n));         break;
+        case K_RATE | SET:   send_eps(EPA_REPLY_READONLY);      break;
+        case K_HIST | QUERY: send_hist(n);                      break;
+        case K_HIST | SET:   send_eps(EPA_REPLY_READONLY);      break;
+        case K_HIST | NODE:  parse_hist(n, msg);                break;
+        case K_FILT | QUERY: send_micros(scpi.input_filter[n]); break;
+        case K_FILT | SET:
+            if (parse_micros(msg, tmp, 0, 1000000, DEF_INPUT_FILTER)) { scpi.input_filter[n] = tmp; update = 1;   }
+            else                                                      { send_eps(EPA_REPLY_INVALID_ARG);          }
+            break;
+        case K_REJ | QUERY:
+        {
+            noInterrupts();
+            const long rejected = scpi_input_rejected[n];
+            interrupts();
+            send_int(rejected);
+            break;
+        }
+        case K_REJ | SET:   send_eps(EPA_REPLY_READONLY);     break;
+        case K_FREQ | QUERY:
+            if (scpi.input_mode[n] == COUNTER)                     { send_milli(scpi_input_freq);              }
+            else                                                   { send_eps(EPA_REPLY_INVALID_CMD);          }
+            break;
+        case K_FREQ | SET: send_eps(EPA_REPLY_READONLY); break;
+        default:           send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (start(msg, "MOD", "e", " ",   rest))
+
+    if (update)
     {
-        if      (equal(rest, "OFF"))              { scpi.input_mode[n] = 0;       update = 1; }
-        else if (equal(rest, "RIS", "ing"))       { scpi.input_mode[n] = RISING;  update = 1; }
-        else if (equal(rest, "FALL", "ing"))      { scpi.input_mode[n] = FALLING; update = 1; }
-        else if (equal(rest, "CHA", "nge"))       { scpi.input_mode[n] = CHANGE;  update = 1; }
-        else                                      { send_eps(EPA_REPLY_INVALID_ARG);          }
+        update_masks();
+        update_input(n);
+        update_capture();
+        send_str("OK");
     }
-    else if (equal(msg, "PULL", "up", "?"))       { send_hex(scpi.input_pullup[n]);           }
-    else if (start(msg, "PULL", "up", " ", rest))
+}
+
+void parse_hist(const int n, const char *msg)
+{
+    static const char keys[][KEYLEN] PROGMEM = {"CLEar"};
+    enum                                       { K_CLE };
+
+    switch (parse_key(msg, keys))
     {
-        if      (equal(rest, "1"))                { scpi.input_pullup[n] = 1;     update = 1; }
-        else if (equal(rest, "0"))                { scpi.input_pullup[n] = 0;     update = 1; }
-        else                                      { send_eps(EPA_REPLY_INVALID_ARG);          }
+        case K_CLE | BARE: hist_clear(n); send_str("OK"); break;
+        default:           send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (equal(msg, "INV", "ert", "?"))       { send_hex(scpi.input_invert[n]);           }
-    else if (start(msg, "INV", "ert", " ", rest))
+}
+
+void parse_inputs(const char *msg)  // settings and queries for all inputs
+{
+    static const char keys[][KEYLEN] PROGMEM = {"RATE", "GATE", "WINDow"};
+    enum                                       { K_RATE, K_GATE, K_WIND };
+    long tmp;
+
+    switch (parse_key(msg, keys))
     {
-        if      (equal(rest, "1"))                { scpi.input_invert[n] = 1;     update = 1; }
-        else if (equal(rest, "0"))                { scpi.input_invert[n] = 0;     update = 1; }
-        else                                      { send_eps(EPA_REPLY_INVALID_ARG);          }
+        case K_RATE | QUERY: send_rates();                 break;
+        case K_RATE | SET:   send_eps(EPA_REPLY_READONLY); break;
+        case K_GATE | QUERY: send_micros(scpi.input_gate); break;
+        case K_GATE | SET:
+            if (parse_micros(msg, tmp, 10000, 60000000, DEF_INPUT_GATE))
+            {
+                scpi.input_gate = tmp / 1000 * 1000;  // whole ms
+                for (int n = 0; n < NCHAN; n++) { if (conf_input_pin[n] == conf_counter_pin) { update_counter(n); } }
+                send_str("OK");
+            }
+            else { send_eps(EPA_REPLY_INVALID_ARG); }
+            break;
+        case K_WIND | QUERY: send_micros(scpi.input_window); break;
+        case K_WIND | SET:
+            if (parse_micros(msg, tmp, 80000, 60000000, DEF_INPUT_WINDOW))
+            {
+                scpi.input_window = tmp / (1000L*NSUB) * (1000L*NSUB);  // whole ms per sub-window
+                update_rate();
+                send_str("OK");
+            }
+            else { send_eps(EPA_REPLY_INVALID_ARG); }
+            break;
+        default: send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (equal(msg, "COUN", "t", "?"))        { send_int(scpi_input_count[n]);            }
-    else if (start(msg, "COUN", "t", " ",  rest)) { send_eps(EPA_REPLY_READONLY);             }
-    else if (equal(msg, "VAL", "ue", "?"))        { send_hex(read_input(n));                  }
-    else if (start(msg, "VAL", "ue", " ",  rest)) { send_eps(EPA_REPLY_READONLY);             }
-    else                                          { send_eps(EPA_REPLY_INVALID_CMD);          }
+}
 
-    if (update)
+void parse_coinc(const int g, const char *msg)
+{
+    static const char keys[][KEYLEN] PROGMEM = {"MASK", "COUNt"};
+    enum                                       { K_MASK, K_COUN };
+    byte mask;
+
+    switch (parse_key(msg, keys))
     {
-        update_masks();
-        update_input(n);
-        y_old = pack_inputs();
-        send_str("OK");
+        case K_MASK | QUERY: send_mask(scpi.coinc_mask[g]); break;
+        case K_MASK | SET:
+            if (parse_mask(msg, mask) && (mask == 0 || (mask & (mask - 1))))  // NONE or at least two inputs
+            {
+                scpi.coinc_mask[g] = mask;
+                coinc_clear(g);
+                send_str("OK");
+            }
+            else { send_eps(EPA_REPLY_INVALID_ARG); }
+            break;
+        case K_COUN | QUERY: send_int(scpi_coinc_count[g]); break;
+        case K_COUN | SET:   send_eps(EPA_REPLY_READONLY);  break;
+        default:             send_eps(EPA_REPLY_INVALID_CMD);
+    }
+}
+
+void parse_coincs(const char *msg)  // settings for all coincidence groups
+{
+    static const char keys[][KEYLEN] PROGMEM = {"WINDow", "ONLY"};
+    enum                                       { K_WIND,   K_ONLY };
+    long tmp;
+
+    switch (parse_key(msg, keys))
+    {
+        case K_WIND | QUERY: send_micros(scpi.coinc_window); break;
+        case K_WIND | SET:
+            if (parse_micros(msg, tmp, 0, 1000000, DEF_COINC_WINDOW)) { scpi.coinc_window = tmp; send_str("OK"); }
+            else                                                      { send_eps(EPA_REPLY_INVALID_ARG);       }
+            break;
+        case K_ONLY | QUERY: send_hex(scpi.coinc_only); break;
+        case K_ONLY | SET:
+            if      (equal(msg, "1"))                              { scpi.coinc_only = 1; send_str("OK");   }
+            else if (equal(msg, "0"))                              { scpi.coinc_only = 0; send_str("OK");   }
+            else                                                   { send_eps(EPA_REPLY_INVALID_ARG);       }
+            break;
+        default: send_eps(EPA_REPLY_INVALID_CMD);
+    }
+}
+
+void parse_event(const char *msg)
+{
+    static const char keys[][KEYLEN] PROGMEM = {"OVERflow"};
+    enum                                       { K_OVER };
+
+    switch (parse_key(msg, keys))
+    {
+        case K_OVER | QUERY:
+        {
+            noInterrupts();
+            const long overflow = ev_overflow;
+            interrupts();
+            send_int(overflow);
+            break;
+        }
+        case K_OVER | SET: send_eps(EPA_REPLY_READONLY); break;
+        default:           send_eps(EPA_REPLY_INVALID_CMD);
+    }
+}
+
+void parse_data(const char *msg)
+{
+    static const char keys[][KEYLEN] PROGMEM = {"ENable", "COUNt", "OVERflow", "FETCh", "CLEar"};
+    enum                                       { K_EN,     K_COUN,  K_OVER,     K_FETC,  K_CLE };
+    long m;
+
+    switch (parse_key(msg, keys))
+    {
+        case K_EN | QUERY: send_hex(scpi_data_enable); break;
+        case K_EN | SET:
+            if      (equal(msg, "1"))         { scpi_data_enable = 1; send_str("OK"); }
+            else if (equal(msg, "0"))         { scpi_data_enable = 0; send_str("OK"); }
+            else                              { send_eps(EPA_REPLY_INVALID_ARG);      }
+            break;
+        case K_COUN | QUERY: send_int(scpi_data_count);    break;
+        case K_COUN | SET:   send_eps(EPA_REPLY_READONLY); break;
+        case K_OVER | QUERY: send_int(scpi_data_overflow); break;
+        case K_OVER | SET:   send_eps(EPA_REPLY_READONLY); break;
+        case K_FETC | QUERY: send_data(scpi_data_count);   break;
+        case K_FETC | QUERY | SET:
+            if (parse_num(msg, m, 0, NUM_MAX)) { send_data(min(m, scpi_data_count)); }
+            else                                { send_eps(EPA_REPLY_INVALID_ARG);    }
+            break;
+        case K_CLE | BARE: data_clear(); send_str("OK"); break;
+        default:           send_eps(EPA_REPLY_INVALID_CMD);
     }
 }
 
 void parse_output(const char *msg)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"SERial", "UDP"};
+    enum                                       { K_SER,    K_UDP };
 
-    if      (start(msg, "SER", "ial", ":", rest)) { parse_serial(rest);              }
-    else if (start(msg, "UDP:",            rest)) { parse_udp(rest);                 }
-    else                                          { send_eps(EPA_REPLY_INVALID_CMD); }
+    switch (parse_key(msg, keys))
+    {
+        case K_SER | NODE: parse_serial(msg); break;
+        case K_UDP | NODE: parse_udp(msg);    break;
+        default:           send_eps(EPA_REPLY_INVALID_CMD);
+    }
 }
 
 void parse_serial(const char *msg)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"ENable", "FORMat"};
+    enum                                       { K_EN,     K_FORM };
 
-    if      (equal(msg, "EN", "able", "?"))       { send_hex(scpi.output_serial);           }
-    else if (start(msg, "EN", "able", " ", rest))
+    switch (parse_key(msg, keys))
     {
-        if      (equal(rest, "1"))                { scpi.output_serial = 1; send_str("OK"); }
-        else if (equal(rest, "0"))                { scpi.output_serial = 0; send_str("OK"); }
-        else                                      { send_eps(EPA_REPLY_INVALID_ARG);        }
+        case K_EN | QUERY: send_hex(scpi.output_serial); break;
+        case K_EN | SET:
+            if      (equal(msg, "1"))          { scpi.output_serial = 1; send_str("OK");                    }
+            else if (equal(msg, "0"))          { scpi.output_serial = 0; send_str("OK");                    }
+            else                               { send_eps(EPA_REPLY_INVALID_ARG);                           }
+            break;
+        case K_FORM | QUERY:
+            send_str(scpi.output_serial_format == FORMAT_BINARY ? "BINARY" :
+                                                                  "TEXT");
+            break;
+        case K_FORM | SET:
+            if      (equal(msg, "TEXT"))       { scpi.output_serial_format = FORMAT_TEXT; send_str("OK");   }
+            else if (equal(msg, "BIN", "ary")) { scpi.output_serial_format = FORMAT_BINARY; send_str("OK"); }
+            else                               { send_eps(EPA_REPLY_INVALID_ARG);                           }
+            break;
+        default: send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else                                          { send_eps(EPA_REPLY_INVALID_CMD);        }
 }
 
 void parse_udp(const char *msg)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"ENable", "DESTination", "PORT", "BATCh", "LATency"};
+    enum                                       { K_EN,     K_DEST,        K_PORT, K_BATC,  K_LAT };
+    long tmp;
 
-    if      (equal(msg, "EN", "able", "?"))            { send_hex(scpi.output_udp);           }
-    else if (start(msg, "EN", "able", " ",       rest))
+    switch (parse_key(msg, keys))
     {
-        if      (equal(rest, "1"))                     { scpi.output_udp = 1; send_str("OK"); }
-        else if (equal(rest, "0"))                     { scpi.output_udp = 0; send_str("OK"); }
-        else                                           { send_eps(EPA_REPLY_INVALID_ARG);     }
+        case K_EN | QUERY: send_hex(scpi.output_udp); break;
+        case K_EN | SET:
+            if      (equal(msg, "1"))                                 { scpi.output_udp = 1; send_str("OK");                        }
+            else if (equal(msg, "0"))                                 { batch_flush(); scpi.output_udp = 0; send_str("OK");         }
+            else                                                      { send_eps(EPA_REPLY_INVALID_ARG);                            }
+            break;
+        case K_DEST | QUERY: send_ip(scpi.output_udp_dest); break;
+        case K_DEST | SET:
+            if (parse_ip(msg, scpi.output_udp_dest))                  { send_str("OK");                                             }
+            else                                                      { send_eps(EPA_REPLY_INVALID_ARG);                            }
+            break;
+        case K_PORT | QUERY: send_int(scpi.output_udp_port); break;
+        case K_PORT | SET:
+            if (parse_port(msg, scpi.output_udp_port, DEF_UDP_PORT))  { send_str("OK");                                             }
+            else                                                      { send_eps(EPA_REPLY_INVALID_ARG);                            }
+            break;
+        case K_BATC | QUERY: send_int(scpi.output_udp_batch); break;
+        case K_BATC | SET:
+            if (parse_num(msg, tmp, 0, NBATCH, DEF_UDP_BATCH))        { batch_flush(); scpi.output_udp_batch = tmp; send_str("OK"); }
+            else                                                      { send_eps(EPA_REPLY_INVALID_ARG);                            }
+            break;
+        case K_LAT | QUERY: send_micros(scpi.output_udp_latency); break;
+        case K_LAT | SET:
+            if (parse_micros(msg, tmp, 0, 10000000, DEF_UDP_LATENCY)) { scpi.output_udp_latency = tmp; send_str("OK");              }
+            else                                                      { send_eps(EPA_REPLY_INVALID_ARG);                            }
+            break;
+        default: send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (equal(msg, "DEST", "ination", "?"))       { send_ip(scpi.output_udp_dest);       }
-    else if (start(msg, "DEST", "ination", " ", rest))
+}
+
+void parse_system(const char *msg)
+{
+    static const char keys[][KEYLEN] PROGMEM = {"REBoot", "COMMunicate"};
+    enum                                       { K_REB,    K_COMM };
+
+    switch (parse_key(msg, keys))
     {
-        if (parse_ip(rest, scpi.output_udp_dest))      { send_str("OK");                      }
-        else                                           { send_eps(EPA_REPLY_INVALID_ARG);     }
+        case K_REB | BARE:
+            send_eps(EPA_REPLY_REBOOTING);
+            wdt_enable(WDTO_1S);
+            while(1);
+        case K_COMM | NODE: parse_comm(msg); break;
+        default:            send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (equal(msg, "PORT?"))                      { send_int(scpi.output_udp_port);      }
-    else if (start(msg, "PORT ",                rest))
+}
+
+void parse_comm(const char *msg)
+{
+    static const char keys[][KEYLEN] PROGMEM = {"LAN", "SERial"};
+    enum                                       { K_LAN, K_SER };
+
+    switch (parse_key(msg, keys))
     {
-        if (parse_port(rest, scpi.output_udp_port))    { send_str("OK");                      }
-        else                                           { send_eps(EPA_REPLY_INVALID_ARG);     }
+        case K_LAN | NODE: parse_lan(msg);  break;
+        case K_SER | NODE: parse_baud(msg); break;
+        default:           send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else                                               { send_eps(EPA_REPLY_INVALID_CMD);     }
 }
 
-void parse_system(const char *msg)
+void parse_baud(const char *msg)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"BAUD"};
+    enum                                       { K_BAUD };
+    long baud;
 
-    if (equal(msg, "REB", "oot"))
+    switch (parse_key(msg, keys))
     {
-        send_eps(EPA_REPLY_REBOOTING);
-        wdt_enable(WDTO_1S);
-        while(1);
+        case K_BAUD | QUERY:
+            EEPROM.get(EPA_SERIAL_BAUD, baud);
+            send_int(baud);
+            break;
+        case K_BAUD | SET:
+            if (parse_num(msg, baud, 300, 2000000, DEF_SERIAL_BAUD))
+            {
+                EEPROM.put(EPA_SERIAL_BAUD, baud);  // save immediately
+                send_str("OK");
+                update_baud();  // the reply still goes out at the old rate
+            }
+            else { send_eps(EPA_REPLY_INVALID_ARG); }
+            break;
+        default: send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (start(msg, "COMM", "unicate", ":LAN:", rest)) { parse_lan(rest);                 }
-    else                                                   { send_eps(EPA_REPLY_INVALID_CMD); }
 }
 
 void parse_lan(const char *msg)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"MODe", "MAC", "IP", "GATEway", "SUBnet"};
+    enum                                       { K_MOD,  K_MAC, K_IP, K_GATE,    K_SUB };
     bool update = 0;
 
     SCPI_LAN scpi_lan;
     EEPROM.get(EPA_SCPI_LAN, scpi_lan);
 
-    if (equal(msg, "MOD", "e", "?"))
+    switch (parse_key(msg, keys))
     {
-        send_lan(scpi_lan.mode, NOEOL);
+        case K_MOD | QUERY:
+            send_lan(scpi_lan.mode, NOEOL);
 #ifdef LAN
-        send_str(" (ACTUAL: ",  NOEOL);
-        send_lan(scpi_lan_mode, NOEOL);
-        send_str(")");
+            send_str(" (ACTUAL: ",  NOEOL);
+            send_lan(scpi_lan_mode, NOEOL);
+            send_str(")");
 #else
-        send_str(" (ACTUAL: NOT AVAILABLE)");
+            send_str(" (ACTUAL: NOT AVAILABLE)");
 #endif
+            break;
+        case K_MOD | SET:
+            if      (equal(msg, "OFF"))        { scpi_lan.mode = LAN_OFF;    update = 1; }
+            else if (equal(msg, "DHCP"))       { scpi_lan.mode = LAN_DHCP;   update = 1; }
+            else if (equal(msg, "STAT", "ic")) { scpi_lan.mode = LAN_STATIC; update = 1; }
+            else                               { send_eps(EPA_REPLY_INVALID_ARG);        }
+            break;
+        case K_MAC | QUERY: send_mac(scpi_lan.mac); break;
+        case K_MAC | SET:
+            if (parse_mac(msg, scpi_lan.mac))  { update = 1;                             }
+            else                               { send_eps(EPA_REPLY_INVALID_ARG);        }
+            break;
+        case K_IP   | QUERY: send_ip(scpi_lan_ip);                               break;
+        case K_IP   | SET:   send_eps(EPA_REPLY_READONLY);                       break;
+        case K_IP   | NODE:  parse_lan_ip(msg, scpi_lan.ip_static,      update); break;
+        case K_GATE | QUERY: send_ip(scpi_lan_gateway);                          break;
+        case K_GATE | SET:   send_eps(EPA_REPLY_READONLY);                       break;
+        case K_GATE | NODE:  parse_lan_ip(msg, scpi_lan.gateway_static, update); break;
+        case K_SUB  | QUERY: send_ip(scpi_lan_subnet);                           break;
+        case K_SUB  | SET:   send_eps(EPA_REPLY_READONLY);                       break;
+        case K_SUB  | NODE:  parse_lan_ip(msg, scpi_lan.subnet_static,  update); break;
+        default:             send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (start(msg, "MOD", "e", " ", rest))
-    {
-        if      (equal(rest, "OFF"))          { scpi_lan.mode = LAN_OFF;    update = 1;                                }
-        else if (equal(rest, "DHCP"))         { scpi_lan.mode = LAN_DHCP;   update = 1;                                }
-        else if (equal(rest, "STAT", "ic"))   { scpi_lan.mode = LAN_STATIC; update = 1;                                }
-        else                                  { send_eps(EPA_REPLY_INVALID_ARG);                                       }
-
-    }
-    else if (equal(msg, "MAC?"))              { send_mac(scpi_lan.mac);                                                }
-    else if (start(msg, "MAC ", rest))
-    {
-        if (parse_mac(rest, scpi_lan.mac))    { update = 1;                                                            }
-        else                                  { send_eps(EPA_REPLY_INVALID_ARG);                                       }
-    }
-    else if (start(msg, "IP",          rest)) { parse_lan_ip(rest, scpi_lan_ip,      scpi_lan.ip_static,      update); }
-    else if (start(msg, "GATE", "way", rest)) { parse_lan_ip(rest, scpi_lan_gateway, scpi_lan.gateway_static, update); }
-    else if (start(msg, "SUB", "net",  rest)) { parse_lan_ip(rest, scpi_lan_subnet,  scpi_lan.subnet_static,  update); }
-    else                                      { send_eps(EPA_REPLY_INVALID_CMD);                                       }
 
     if (update)
     {
@@ -420,17 +1193,20 @@ void parse_lan(const char *msg)
     }
 }
 
-void parse_lan_ip(const char *msg, const uint32_t addr, uint32_t &addr_static, bool &update)
+void parse_lan_ip(const char *msg, uint32_t &addr_static, bool &update)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"STATic"};
+    enum                                       { K_STAT };
 
-    if      (equal(msg, "?"))                      { send_ip(addr);                   }
-    else if (start(msg, " ", rest))                { send_eps(EPA_REPLY_READONLY);    }
-    else if (equal(msg, ":STAT", "ic", "?"))       { send_ip(addr_static);            }
-    else if (start(msg, ":STAT", "ic", " ", rest))
+    switch (parse_key(msg, keys))
     {
-        if (parse_ip(rest, addr_static))           { update = 1;                      }
-        else                                       { send_eps(EPA_REPLY_INVALID_ARG); }
+        case K_STAT | QUERY:
+            send_ip(addr_static);
+            break;
+        case K_STAT | SET:
+            if (parse_ip(msg, addr_static)) { update = 1;                      }
+            else                            { send_eps(EPA_REPLY_INVALID_ARG); }
+            break;
+        default: send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else                                           { send_eps(EPA_REPLY_INVALID_CMD); }
 }
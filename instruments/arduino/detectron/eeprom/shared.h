@@ -1,32 +1,58 @@
 #include <EEPROM.h>
 
-#define NCHAN 7   // max 8
+#define NCHAN 8   // max 8
+#define NCOINC 4  // coincidence groups
 #define ESLEN 40  // includes null-terminator
 
+#define COUNTER 0x10  // input mode besides OFF (0) and Arduino's CHANGE, FALLING, RISING
+
+#define FORMAT_TEXT   0
+#define FORMAT_BINARY 1
+
 #define LAN_OFF    0
 #define LAN_DHCP   1
 #define LAN_STATIC 2
 
+// defaults of numeric settings, also taken for DEFault arguments:
+#define DEF_INPUT_FILTER   0
+#define DEF_INPUT_WINDOW   1000000
+#define DEF_INPUT_GATE     1000000
+#define DEF_COINC_WINDOW   1
+#define DEF_UDP_PORT       5000
+#define DEF_UDP_BATCH      0
+#define DEF_UDP_LATENCY    10000
+#define DEF_SERIAL_BAUD    9600
+
 // EEPROM addresses:
 #define EPA_COMMIT            0
 #define EPA_SCPI              4
-#define EPA_SCPI_LAN          80
-#define EPA_IDN               100
-#define EPA_REPLY_READONLY    140
-#define EPA_REPLY_INVALID_CMD 180
-#define EPA_REPLY_INVALID_ARG 220
-#define EPA_REPLY_REBOOT_REQ  260
-#define EPA_REPLY_REBOOTING   300
+#define EPA_SCPI_LAN          120
+#define EPA_IDN               140
+#define EPA_REPLY_READONLY    180
+#define EPA_REPLY_INVALID_CMD 220
+#define EPA_REPLY_INVALID_ARG 260
+#define EPA_REPLY_REBOOT_REQ  300
+#define EPA_REPLY_REBOOTING   340
+#define EPA_SERIAL_BAUD       380  // long
 
 struct SCPI
 {
-    byte     input_mode   [NCHAN];  // :INput<n>:MODe           OFF, RISing, FALLing, CHAnge
+    byte     input_mode   [NCHAN];  // :INput<n>:MODe           OFF, RISing, FALLing, CHAnge, or COUNter (conf_counter_pin only)
     bool     input_pullup [NCHAN];  // :INput<n>:PULLup         0 = floating input, 1 = enable pull-up resistor
     bool     input_invert [NCHAN];  // :INput<n>:INVert         0 = non-inverting, 1 = inverting
+    long     input_filter [NCHAN];  // :INput<n>:FILTer         hold-off time after an accepted transition in s (stored in us), 0 = off
+    long     input_window;          // :INput:WINDow            rate meter window in s (stored in us)
+    long     input_gate;            // :INput:GATE              frequency counter gate time in s (stored in us)
+    byte     coinc_mask [NCOINC];   // :COINcidence<g>:MASK     inputs of group g, e.g. 1,2,5, or NONE
+    long     coinc_window;          // :COINcidence:WINDow      max time between the first and last event of a coincidence in s (stored in us)
+    bool     coinc_only;            // :COINcidence:ONLY        0 = output all events, 1 = only events completing a coincidence
     bool     output_serial;         // :OUTput:SERial:ENable    0 = disabled, 1 = enabled
+    byte     output_serial_format;  // :OUTput:SERial:FORMat    TEXT (byte old, byte new, CR LF) or BINary (framed, see below)
     bool     output_udp;            // :OUTput:UDP:ENable       0 = disabled, 1 = enabled
     uint32_t output_udp_dest;       // :OUTput:UDP:DESTination  ip address
     uint16_t output_udp_port;       // :OUTput:UDP:PORT         port number
+    byte     output_udp_batch;      // :OUTput:UDP:BATCh        max events per datagram, 0 = one 2-byte datagram per event
+    long     output_udp_latency;    // :OUTput:UDP:LATency      max age of a batched event before sending in s (stored in us)
 };
 
 struct SCPI_LAN
@@ -40,8 +66,42 @@ struct SCPI_LAN
 
 // notes on SCPI settings:
 //   - bool values must be 0 or 1
-//   - <n> in input configs is {1, 2, 3, 4, 5, 6, 7} for outputs {A, B, C, D, E, F, G}
+//   - <n> in input configs is {1, 2, 3, 4, 5, 6, 7, 8} for outputs {A, B, C, D, E, F, G, H}
 //   - abbreviations are supported where noted, e.g INVert matches both INV and INVERT
+//   - messages end in LF or CR (or both) and several may be sent at once, they are answered in order, one line per command,
+//     a message may hold commands separated by ';' (e.g. :INput1:FILTer 0.01;INVert 1), where a command starting with neither ':' nor '*'
+//     continues from the node of the previous one (spaces after the ';' are ignored)
+//   - numbers may carry a sign, decimal point, and exponent (e.g. 1.5e-3), times a unit S, MS, US, or NS (e.g. 10 ms),
+//     or be MINimum, MAXimum, or DEFault (the *RST value) instead, times are rounded half up to whole us,
+//     values out of range are rejected rather than clipped
+//   - transitions are captured by pin interrupts where available (pins 2, 3, 7 external, pins 8, 9 pin-change),
+//     other inputs are polled every loop (about 1 ms), see :EVENt:OVERflow for events lost at high rates
+//   - all inputs are sampled together from the port registers (within a few CPU cycles), so simultaneous edges yield one event
+//   - batched datagrams (BATCH > 0) hold a header (uint32 sequence number, uint32 timestamp of first event, byte count N)
+//     followed by N records (byte old, byte new, uint16 ticks since previous event), little-endian, timestamps in 0.5 us ticks,
+//     a batch is sent when full, when its first event is LATENCY old, or early if the next event is more than 0xFFFF ticks later
+//   - BINARY serial frames are 0x7E, byte old, byte new, uint32 timestamp in 0.5 us ticks (little-endian), byte checksum, 0x7E,
+//     with 0x7E, 0x7D, LF, and CR inside escaped as 0x7D followed by the byte XOR 0x20, the unescaped bytes add up to 0 mod 256,
+//     frames never split SCPI replies, and anything outside 0x7E ... 0x7E is a reply
+//   - with :DATA:ENable 1, events matching the input modes are also recorded in RAM until read by :DATA:FETCh? (oldest first),
+//     records are uint32 timestamp in 0.5 us ticks, byte old, byte new (little-endian), newer events are dropped when full
+//   - :INput<n>:RATE is averaged over the last WINDOW (80 ms to 60 s, a multiple of 8 ms), sliding in steps of WINDOW/8,
+//     and over the time since reboot or the last change of settings while that is shorter
+//   - :INput<n>:HISTogram bins intervals between consecutive events of one input by factors of 4: bin 1 is below 32 us,
+//     bin k from 32 us * 4^(k-2) to 32 us * 4^(k-1), bin 14 everything from 537 s (intervals longer than 2147 s wrap around),
+//     per-bin counts and per-sub-window rate counts saturate at 65535
+//   - <g> in coincidence configs is {1, 2, 3, 4}, a group needs at least two inputs, events count as for :INput<n>:COUNt,
+//     a group fires on the event that completes one event on each of its inputs within WINDOW (0 to 1 s),
+//     after which each input needs a new event, a single event may complete several groups
+//   - with :COINcidence:ONLY 1, only events that fire a group are sent and recorded, counts, rates and histograms still see all
+//   - with FILTER > 0 (up to 1 s), transitions of an input within FILTER of its last accepted one are ignored (see :INput<n>:REJected),
+//     an input left at a different level is reported once the hold-off expires, time-stamped when loop() notices (within about 1 ms)
+//   - MODE COUNTER (input 8, pin 12) counts rising edges (falling if INVERT 1) in hardware, up to several MHz, without events,
+//     COUNT then reports the 48-bit total since the mode or its settings were last set, and FREQUENCY the rate over the last GATE
+//     (10 ms to 60 s, whole ms, timed by the event clock), both restart on *RCL, *RST, and changes of GATE
+//   - :SYSTem:COMMunicate:SERial:BAUD is saved immediately and applied right after its reply (300 to 2000000),
+//     it has no effect on the data rate of boards with native USB like the Leonardo, where Serial is a USB CDC port
+//   - LAN clients are served one message at a time, a client pausing for more than 2 s within a message loses that message
 //   - LAN settings do not take effect until reboot!
 
 void scpi_default(SCPI &s)
@@ -51,10 +111,19 @@ void scpi_default(SCPI &s)
         s.input_mode[n]   = (n == 0 ? RISING : 0);  // 0 means OFF, other options are non-zero
         s.input_pullup[n] = 1;
         s.input_invert[n] = 0;
+        s.input_filter[n] = DEF_INPUT_FILTER;
     }
 
-    s.output_serial   = 1;
-    s.output_udp      = 0;
-    s.output_udp_dest = 0xC800A8C0;  // 192.168.0.200
-    s.output_udp_port = 5000;
+    s.input_window         = DEF_INPUT_WINDOW;
+    s.input_gate           = DEF_INPUT_GATE;
+    for (int g = 0; g < NCOINC; g++) { s.coinc_mask[g] = 0; }
+    s.coinc_window         = DEF_COINC_WINDOW;
+    s.coinc_only           = 0;
+    s.output_serial        = 1;
+    s.output_serial_format = FORMAT_TEXT;
+    s.output_udp           = 0;
+    s.output_udp_dest      = 0xC800A8C0;  // 192.168.0.200
+    s.output_udp_port      = DEF_UDP_PORT;
+    s.output_udp_batch     = DEF_UDP_BATCH;
+    s.output_udp_latency   = DEF_UDP_LATENCY;
 }
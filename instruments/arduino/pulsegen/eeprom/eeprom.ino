@@ -1,6 +1,7 @@
 #include "shared.h"
 
 const unsigned long conf_commit                    = 0x1234abc;  // edit to match current commit before compile/download!
+const long          conf_serial_baud               = DEF_SERIAL_BAUD;
 const char          conf_idn               [ESLEN] = "SDI PULSE GENERATOR";
 const char          conf_reply_readonly    [ESLEN] = "ERROR: READ-ONLY SETTING";
 const char          conf_reply_invalid_cmd [ESLEN] = "ERROR: INVALID COMMAND OR QUERY";
@@ -8,6 +9,8 @@ const char          conf_reply_invalid_arg [ESLEN] = "ERROR: INVALID ARGUMENT";
 const char          conf_reply_reboot_req  [ESLEN] = "INFO: REBOOT TO APPLY LAN SETTINGS";
 const char          conf_reply_rebooting   [ESLEN] = "INFO: REBOOTING . . .";
 const char          conf_reply_check       [ESLEN] = "WARNING: CHECK CHANNEL TIMING";
+const char          conf_reply_busy        [ESLEN] = "ERROR: PULSE SEQUENCE RUNNING";
+const char          conf_reply_pending     [ESLEN] = "ERROR: CHANGES PENDING, COMMIT FIRST";
 
 void setup()
 {
@@ -21,6 +24,12 @@ void setup()
     scpi_lan_initial(scpi_lan);
     EEPROM.put(EPA_SCPI_LAN, scpi_lan);
 
+    EEPROM.put(EPA_SERIAL_BAUD, conf_serial_baud);
+
+    byte list_len[NCHAN] = {0};  // empty edge lists, data need not be initialized
+    EEPROM.put(EPA_LIST_LEN,   list_len);
+    EEPROM.put(EPA_LIST_EDGES, list_len);
+
     EEPROM.put(EPA_IDN,               conf_idn);
     EEPROM.put(EPA_REPLY_READONLY,    conf_reply_readonly);
     EEPROM.put(EPA_REPLY_INVALID_CMD, conf_reply_invalid_cmd);
@@ -28,6 +37,8 @@ void setup()
     EEPROM.put(EPA_REPLY_REBOOT_REQ,  conf_reply_reboot_req);
     EEPROM.put(EPA_REPLY_REBOOTING,   conf_reply_rebooting);
     EEPROM.put(EPA_REPLY_CHECK,       conf_reply_check);
+    EEPROM.put(EPA_REPLY_BUSY,        conf_reply_busy);
+    EEPROM.put(EPA_REPLY_PENDING,     conf_reply_pending);
 
     Serial.begin(9600);
 }
@@ -62,6 +73,16 @@ void loop()
     Serial.print(sizeof(scpi_lan));
     Serial.println("/...");
 
+    long baud;
+    EEPROM.get(EPA_SERIAL_BAUD, baud);
+
+    Serial.print("EPA_SERIAL_BAUD/");
+    Serial.print(EPA_SERIAL_BAUD);
+    Serial.print("/");
+    Serial.print(sizeof(baud));
+    Serial.print("/");
+    Serial.println(baud);
+
     check_eps(EPA_IDN,               "EPA_IDN");
     check_eps(EPA_REPLY_READONLY,    "EPA_REPLY_READONLY");
     check_eps(EPA_REPLY_INVALID_CMD, "EPA_REPLY_INVALID_CMD");
@@ -69,6 +90,8 @@ void loop()
     check_eps(EPA_REPLY_REBOOT_REQ,  "EPA_REPLY_REBOOT_REQ");
     check_eps(EPA_REPLY_REBOOTING,   "EPA_REPLY_REBOOTING");
     check_eps(EPA_REPLY_CHECK,       "EPA_CHECK");
+    check_eps(EPA_REPLY_BUSY,        "EPA_REPLY_BUSY");
+    check_eps(EPA_REPLY_PENDING,     "EPA_REPLY_PENDING");
 
     delay(4000);
 }
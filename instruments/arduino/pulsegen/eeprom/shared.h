@@ -2,28 +2,51 @@
 
 #define NCHAN 4
 #define ESLEN 40  // includes null-terminator
+#define LISTLEN 128  // words of edge list shared by all channels, one per edge (two if more than 0x7FFF ticks after the previous one), at most 255
 
 #define LAN_OFF    0
 #define LAN_DHCP   1
 #define LAN_STATIC 2
 
+#define DRIVE_SW 0
+#define DRIVE_HW 1
+
+#define MODE_TRAIN 0
+#define MODE_LIST  1
+
+// defaults of numeric settings, also taken for DEFault arguments:
+#define DEF_CLOCK_FREQ_EXT  1000000
+#define DEF_CLOCK_GATE      500000
+#define DEF_PULSE_DELAY     0
+#define DEF_PULSE_WIDTH     10000
+#define DEF_PULSE_PERIOD    20000
+#define DEF_PULSE_CYCLES(n) ((n) == 0)  // first channel only
+#define DEF_SERIAL_BAUD     9600
+
 // EEPROM addresses:
 #define EPA_COMMIT            0
 #define EPA_SCPI              4
-#define EPA_SCPI_LAN          80
-#define EPA_IDN               100
-#define EPA_REPLY_READONLY    140
-#define EPA_REPLY_INVALID_CMD 180
-#define EPA_REPLY_INVALID_ARG 220
-#define EPA_REPLY_REBOOT_REQ  260
-#define EPA_REPLY_REBOOTING   300
-#define EPA_REPLY_CHECK       340
+#define EPA_SCPI_LAN          120
+#define EPA_IDN               140
+#define EPA_REPLY_READONLY    180
+#define EPA_REPLY_INVALID_CMD 220
+#define EPA_REPLY_INVALID_ARG 260
+#define EPA_REPLY_REBOOT_REQ  300
+#define EPA_REPLY_REBOOTING   340
+#define EPA_REPLY_CHECK       380
+#define EPA_REPLY_BUSY        420
+#define EPA_LIST_LEN          460  // NCHAN bytes
+#define EPA_LIST_EDGES        464  // NCHAN bytes
+#define EPA_LIST_DATA         468  // LISTLEN words, up to 724
+#define EPA_SERIAL_BAUD       724  // long
+#define EPA_REPLY_PENDING     728
 
 struct SCPI
 {
     byte clock_src;             // :CLOCK:SRC                 INTernal or EXTernal
     byte clock_edge;            // :CLOCK:EDGE                RISing or FALLing
     long clock_freq_ext;        // :CLOCK:FREQuency:EXTernal  ideal external frequency in Hz -- max 5e6
+    long clock_gate;            // :CLOCK:FREQuency:MEASure:GATE  gate time of background frequency counter in s (stored in us)
     byte trig_edge;             // :TRIGger:EDGE              RISing or FALLing
     bool trig_rearm;            // :TRIGger:REARM             rearm after pulse sequence and on reboot
     long pulse_delay  [NCHAN];  // :PULSe<n>:DELay            delay to first pulse is s (stored in us)
@@ -31,6 +54,8 @@ struct SCPI
     long pulse_period [NCHAN];  // :PULSe<n>:PERiod           pulse period in s (stored in us)
     long pulse_cycles [NCHAN];  // :PULSe<n>:CYCles           number of pulses
     bool pulse_invert [NCHAN];  // :PULSe<n>:INVert           0 = non-inverting, 1 = inverting
+    byte pulse_drive  [NCHAN];  // :PULSe<n>:DRIVe            SW (edge interrupts and port writes) or HW (Timer1 compare unit, if wired)
+    byte pulse_mode   [NCHAN];  // :PULSe<n>:MODe             TRAIN (DELay, WIDth, PERiod, CYCles) or LIST (edge list, see :PULSe<n>:LIST)
 };
 
 struct SCPI_LAN
@@ -46,24 +71,64 @@ struct SCPI_LAN
 //   - bool values must be 0 or 1
 //   - <n> in pulse configs is {1, 2, 3, 4} for outputs {A, B, C, D}
 //   - abbreviations are supported where noted, e.g WIDth matches both WID and WIDTH
+//   - messages end in LF or CR (or both) and several may be sent at once, they are answered in order, one line per command,
+//     a message may hold commands separated by ';' (e.g. :PULSe1:DELay 0.1;WIDth 0.01), where a command starting with neither ':' nor '*'
+//     continues from the node of the previous one (spaces after the ';' are ignored)
+//   - numbers may carry a sign, decimal point, and exponent (e.g. 1.5e-3), times a unit S, MS, US, or NS (e.g. 10 ms), and
+//     :CLOCK:FREQuency:EXTernal one of HZ, KHZ, or MHZ (mega), or be MINimum, MAXimum, or DEFault (the *RST value) instead,
+//     times are rounded half up to whole us, values out of range are rejected rather than clipped
 //   - if WIDTH > PERIOD, the pulse is continuous, i.e. always high if not inverted, full sequence will last DELAY + CYCLES*PERIOD
-//   - (DELAY + PERIOD*CYCLES)/FREQ must be < 4e9, otherwise the channel will not be used (VALID = 0)
+//   - times are converted to clock ticks exactly (rounded to the nearest tick, see :PULSe<n>:ERRor for the accumulated error in ns)
+//   - (DELAY + PERIOD*CYCLES)*FREQ must be < 2^47 ticks (about 800 days at 2 MHz) and WIDTH must be at least one tick, otherwise the channel will not be used (VALID = 0)
+//   - with CYCLES > 1 (and WIDTH < PERIOD), WIDTH or PERIOD - WIDTH must be at least conf_lead_us (8 us), otherwise the channel will not
+//     be used either (VALID = 0), since edges closer than that are polled with interrupts disabled and such a train would block
+//     commands and LAN for its whole length (edges of different channels may still come closer, which only costs their overlap)
+//   - edges that coincide in ticks are written simultaneously if their outputs share a port, otherwise one port after another,
+//     by a model estimate up to about 144 CPU cycles (9 us at 16 MHz) apart with the default pins on four ports (see testing/host/sched_model.cpp)
+//   - with an output on the port of the Ethernet chip select (channel A by default), edges written by port wait for any LAN
+//     transfer in progress rather than being lost, i.e. may be late by up to a few hundred us under LAN traffic (see conf_lan_cs_port)
+//   - DRIVE HW is only available on channels wired to a Timer1 compare pin, none by default (see conf_pulse_oc for rewiring channel D
+//     to pin 11), edges are then tick-exact unless closer than ~8 us to the previous one
+//   - LIST takes a definite-length block of little-endian uint32 tick timestamps (e.g. #216<16 bytes> for two pulses),
+//     strictly increasing, alternating active/inactive and starting active, each < 2^31 ticks after the previous one
+//   - edge lists of all channels share LISTLEN words, one per edge (two if the gap exceeds 0x7FFF ticks), so one channel may hold
+//     up to LISTLEN edges less the words taken by the others, lists are saved and recalled along with the settings,
+//     and are played by the same engine as TRAIN (DRIVE applies alike)
+//   - :SEQuence:STORe copies the current timing, MODE, INVERT, and DRIVE of all channels to a slot (edge lists are not copied, a slot
+//     storing a channel in LIST mode plays its current list), slots follow later clock changes and list uploads,
+//     with LENGTH > 0 each hardware trigger plays slot INDEX and advances it, *TRG replays it without advancing
+//   - with :CONFigure:AUTO 0, clock and pulse settings take effect together on :CONFigure:COMMit (queries return the pending values),
+//     only changed channels are recomputed, *RCL and *RST always take effect immediately, and the LIST of a channel whose
+//     committed MODE is LIST cannot be replaced (commit MODE TRAIN first), :SEQuence:STORe is rejected while changes are pending
+//   - :DIAGnostic:LATency reports the time from trigger interrupt entry to the first edge written by port (count, min, mean, max in ns),
+//     with :DIAGnostic:LATency:AUTO 1 the sequence starts when that edge can first be written rather than conf_start_us before entry,
+//     i.e. AUTO adds delay rather than removing latency: DELAY 0 is not late and all edges keep their spacing, but every edge comes
+//     later by an offset that follows the recent peak latency (decaying over a few dozen triggers, see :DIAGnostic:LATency:OFFSet, in ns,
+//     and :DIAGnostic:LATency:CLEar to reset it)
+//   - the frequency counter runs continuously against the CPU clock, GATE is rounded down to a multiple of 10 ms (10 ms to 60 s)
+//   - settings affecting the pulse sequence are rejected while it runs (see :TRIGger:BUSY), use :ABORt to stop it early
+//   - :SYSTem:COMMunicate:SERial:BAUD is saved immediately and applied right after its reply (300 to 2000000),
+//     it has no effect on the data rate of boards with native USB like the Leonardo, where Serial is a USB CDC port
+//   - LAN clients are served one message at a time, a client pausing for more than 2 s within a message loses that message
 //   - LAN settings do not take effect until reboot!
 
 void scpi_default(SCPI &s)
 {
     s.clock_src      = INTERNAL;
     s.clock_edge     = RISING;
-    s.clock_freq_ext = 1000000;
+    s.clock_freq_ext = DEF_CLOCK_FREQ_EXT;
+    s.clock_gate     = DEF_CLOCK_GATE;
     s.trig_edge      = RISING;
     s.trig_rearm     = 1;
 
     for (int n = 0; n < NCHAN; n++)
     {
-        s.pulse_delay[n]  = 0;
-        s.pulse_width[n]  = 10000;
-        s.pulse_period[n] = 20000;
-        s.pulse_cycles[n] = (n == 0);
+        s.pulse_delay[n]  = DEF_PULSE_DELAY;
+        s.pulse_width[n]  = DEF_PULSE_WIDTH;
+        s.pulse_period[n] = DEF_PULSE_PERIOD;
+        s.pulse_cycles[n] = DEF_PULSE_CYCLES(n);
         s.pulse_invert[n] = 0;
+        s.pulse_drive[n]  = DRIVE_SW;
+        s.pulse_mode[n]   = MODE_TRAIN;
     }
 }
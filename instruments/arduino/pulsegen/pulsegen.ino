@@ -1,6 +1,13 @@
 #define LAN
 #define MSGLEN 64  // includes null-terminator
+#define OUTLEN 64  // reply output buffer, written out at end of line or when full
 #define PORT   18
+#define K_MAX  (1ULL << 47)  // longest sequence in ticks, half of the 48-bit Timer1 timebase
+#define K_MASK ((1ULL << 48) - 1)  // 48-bit Timer1 timebase, differences are taken modulo its wrap
+#define NSLOT  2             // configuration slots for :SEQuence, 220 B of RAM each (BANK plus PULSE), more leave too little stack on the ATmega32u4
+#define DIRTY_ALL ((1 << (NCHAN + 1)) - 1)  // all channels plus clock
+#define NBIN   8             // log2 bins of :DIAGnostic:LATency:HISTogram
+#define NGATE  8             // gates kept for :CLOCK:FREQuency:MEASure:ADEV
 
 #include <avr/wdt.h>
 #include "eeprom/shared.h"  // includes EEPROM.h
@@ -11,21 +18,48 @@ const unsigned long conf_commit             = 0x1234abc;  // edit to match curre
 const long          conf_clock_freq_int     = 2000000;    // board-dependent, assumes prescaler set to /8
 const byte          conf_clock_pin          = 12;         // board-dependent
 const byte          conf_trig_pin           = 2;          // pin must support low-level interrupts
+const byte          conf_trig_intf          = INTF1;      // board-dependent, EIFR flag of the interrupt on trig_pin
 const unsigned int  conf_start_us           = 10;
+const unsigned int  conf_lead_us            = 8;          // edges closer than this are polled rather than scheduled via OCR1A
 const unsigned int  conf_dhcp_cycles        = 1000;
-const unsigned long conf_measure_ms         = 500;
+const long          conf_meas_freq          = 2000000;    // board-dependent, Timer3 frequency with prescaler set to /8
+const long          conf_meas_tick_us       = 10000;      // Timer3 compare period, gate times are multiples of this
 const byte          conf_pulse_pin  [NCHAN] = {8, 7, 6, 5};
 byte *              conf_pulse_port [NCHAN] = {&PORTB, &PORTE, &PORTD, &PORTC};  // board-dependent, must match pulse_pin
 const byte          conf_pulse_mask [NCHAN] = {1 << 4, 1 << 6, 1 << 7, 1 << 6};  // board dependent, must match pulse_pin
+const byte          conf_pulse_oc   [NCHAN] = {0, 0, 0, 0};                      // board dependent, Timer1 compare unit on pulse_pin: 0 = none, 1 = OC1B (pin 10), 2 = OC1C (pin 11)
+
+byte *              conf_lan_cs_port        = &PORTB;     // board-dependent, port of the Ethernet shield's chip select (pin 10)
+
+// the Ethernet library selects its chip with a plain read-modify-write of conf_lan_cs_port, which would undo an edge written
+// by interrupt in between, so if any output is on that port (pins 8 to 11), setup() has SPI transactions run with interrupts off,
+// delaying edges on all ports until the transaction ends (up to a few hundred us for a full reply over a W5100),
+// keep outputs off PORTB to avoid this
+
+// board option for :PULSe4:DRIVe HW, opt in by rewiring channel D from pin 5 to pin 11 (OC1C) and setting its entries above to
+//   pin 11, &PORTB, 1 << 7, compare unit 2
+// pin 10 (OC1B) is taken by the Ethernet shield's chip select
+
+// Timer1 compare units available for :PULSe<n>:DRIVe HW (OC1A is used by the software edge engine):
+volatile uint16_t * const oc_ocr  [2] = {&OCR1B, &OCR1C};
+const byte                oc_com0 [2] = {COM1B0, COM1C0};
+const byte                oc_foc  [2] = {FOC1B,  FOC1C};
+const byte                oc_ocie [2] = {OCIE1B, OCIE1C};
+const byte                oc_ocf  [2] = {OCF1B,  OCF1C};
 
 // SCPI commands:
 //   *IDN?                 model and version
 //   *TRG                  soft trigger, independent of :TRIG:ARMed
-//   *SAV                  save settings to EEPROM (LAN excluded)
-//   *RCL                  recall EEPROM settings (also performed on startup) (LAN excluded)
-//   *RST                  reset to default settings (LAN excluded)
+//   :ABORt                stop running pulse sequence, outputs return to inactive level
+//   *SAV                  save settings and edge lists to EEPROM (LAN excluded)
+//   *RCL                  recall EEPROM settings and edge lists (also performed on startup) (LAN excluded)
+//   *RST                  reset to default settings and clear edge lists (LAN excluded)
 //   :CLOCK:FREQ:INTernal  ideal internal frequency in Hz
-//   :CLOCK:FREQ:MEASure   measured frequency in Hz of currently-configured clock
+//   :CLOCK:FREQ:MEASure   measured frequency in Hz of currently-configured clock, latest gate of the background counter
+//   :CLOCK:FREQ:MEAS:ADEV Allan deviation over the last NGATE gates in ppb
+//   :SEQuence:STORe <i>   copy committed pulse settings to slot i (1 to NSLOT), slots are not saved to EEPROM
+//   :CONFigure:COMMit     apply clock and pulse settings changed since the last commit (if :CONFigure:AUTO is 0)
+//   :DIAG:LAT:CLEar       clear trigger latency statistics and the :DIAG:LAT:AUTO offset (also on clock changes)
 //   :SYSTem:REBoot        reboot the device
 
 // persistent SCPI settings:
@@ -36,7 +70,19 @@ long          scpi_clock_freq;          // :CLOCK:FREQuency                 idea
 volatile long scpi_trig_count;          // :TRIGger:COUNt                   hardware triggers detected since reboot
 volatile bool scpi_trig_armed;          // :TRIGger:ARMed                   armed (read/write)
 volatile bool scpi_trig_ready;          // :TRIGger:READY                   ready (armed plus at least one valid channel)
+volatile bool seq_running;              // :TRIGger:BUSY                    pulse sequence in progress
 bool          scpi_pulse_valid[NCHAN];  // :PULSe<n>:VALid                  output channel has valid/usable pulse sequence
+long          scpi_pulse_error[NCHAN];  // :PULSe<n>:ERRor                  rounding error of sequence end in ns (positive = late)
+long          scpi_seq_length;          // :SEQuence:LENgth                 slots cycled through, one per hardware trigger, 0 = off (read/write)
+long          scpi_seq_index;           // :SEQuence:INDex                  slot played by the next trigger, 0-based here, 1-based in SCPI (read/write)
+bool          scpi_conf_auto;           // :CONFigure:AUTO                  apply clock and pulse settings immediately, otherwise on :CONFigure:COMMit (read/write)
+byte          scpi_conf_dirty;          // :CONFigure:PENDing               channels (bits 0 to NCHAN-1) and clock (bit NCHAN) awaiting commit
+bool          scpi_lat_auto;            // :DIAGnostic:LATency:AUTO         calibrate start offset from measured latency, otherwise conf_start_us (read/write)
+long          lat_count;                // :DIAGnostic:LATency              hardware triggers measured, followed by min, mean and max latency in ns
+unsigned long lat_sum;                  //                                  latency is ticks from run_hw_trig() entry plus DELay to the first edge written by port
+unsigned int  lat_min;
+unsigned int  lat_max;
+long          lat_hist[NBIN];           // :DIAGnostic:LATency:HISTogram    counts for 0, 1, 2-3, 4-7, ... ticks, last bin open-ended
 #ifdef LAN
 byte          scpi_lan_mode;            // :SYSTem:COMMunicate:LAN:MODe     actual mode (writes go to scpi_lan.mode)
 #endif
@@ -44,15 +90,73 @@ uint32_t      scpi_lan_ip;              // :SYSTem:COMMunicate:LAN:IP       curr
 uint32_t      scpi_lan_gateway;         // :SYSTem:COMMunicate:LAN:GATEway  current gateway address
 uint32_t      scpi_lan_subnet;          // :SYSTem:COMMunicate:LAN:SUBnet   current subnet mask
 
-unsigned long          k_delay  [NCHAN];
-unsigned long          k_width  [NCHAN];
-unsigned long          k_period [NCHAN];
-unsigned long          k_end    [NCHAN];
-volatile unsigned long k_next   [NCHAN];
-volatile bool          x_next   [NCHAN];
-volatile int           N_active;
-volatile unsigned long k_cur;
-volatile unsigned int  c_cur;
+struct BANK  // pulse timing in ticks and output settings, as precomputed by bank_pulse()
+{
+    unsigned long long k_delay  [NCHAN];
+    unsigned long long k_width  [NCHAN];
+    unsigned long long k_period [NCHAN];
+    unsigned long long k_end    [NCHAN];
+    byte               mode     [NCHAN];
+    bool               invert   [NCHAN];
+    byte               drive    [NCHAN];
+    bool               active   [NCHAN];  // valid, with at least one edge
+};
+
+struct PULSE  // settings of one channel in SCPI units (us), kept along with each stored BANK
+{
+    long delay;
+    long width;
+    long period;
+    long cycles;
+    byte mode;
+    bool invert;
+    byte drive;
+};
+
+BANK                        bank_live;          // current settings
+BANK                        bank_slot [NSLOT];  // :SEQuence:STORe
+PULSE                       slot_pulse [NSLOT][NCHAN];  // settings behind bank_slot, recomputed by update_slots() on clock changes
+BANK *                      bank;               // played by the next (or running) sequence, selected by update_trig_ready()
+volatile unsigned long long k_next   [NCHAN];
+volatile bool               x_next   [NCHAN];
+volatile byte               q_chan   [NCHAN];  // edge queue, sorted by decreasing k_next, i.e. next edge is q_chan[N_active - 1]
+volatile int                N_active;          // number of channels in edge queue
+volatile bool               seq_hw;            // sequence was started by hardware trigger
+volatile unsigned long long t_start;           // 48-bit Timer1 time of k = 0
+volatile unsigned long long k_cur;
+volatile unsigned int       c_cur;
+volatile uint32_t           c_ovf;             // Timer1 overflows since reboot, i.e. upper 32 bits of 48-bit timebase (wraps, also on hosts with a wider long)
+long                        k_start;            // start offset, sequence starts this many ticks before run_hw_trig() entry (negative = after)
+unsigned int                k_ready_peak;       // time from run_hw_trig() entry to the first edge check, recent peak decaying by 1/16 per trigger, for scpi_lat_auto
+volatile bool               lat_pending;        // first port write of a hardware-triggered sequence still to be measured
+volatile unsigned long long lat_entry;
+unsigned long               meas_k    [NGATE];  // Timer1 ticks counted per gate, ring buffer, filled by meas_update()
+unsigned long               meas_t    [NGATE];  // Timer3 ticks per gate, i.e. actual gate time
+byte                        meas_i;             // next ring entry
+byte                        meas_n;             // valid ring entries
+bool                        meas_primed;        // previous gate edge is valid
+unsigned long long          meas_k_prev;
+unsigned int                meas_c3_prev;
+volatile unsigned int       meas_tick;
+volatile unsigned int       meas_gates;         // gate edges latched by TIMER3_COMPA since the last meas_update(), raw counts below
+volatile unsigned int       meas_c1;
+volatile uint32_t           meas_ovf;
+volatile unsigned int       meas_c3;
+unsigned int                meas_gate_ticks;
+unsigned int                k_lead;
+byte *                      port_addr [NCHAN];  // distinct entries of conf_pulse_port
+byte                        port_idx  [NCHAN];  // index into port_addr for each channel
+int                         N_port;
+volatile byte               port_set  [NCHAN];  // precomputed writes for the next instant, one store per port
+volatile byte               port_clr  [NCHAN];
+volatile byte               oc_active;          // bitmask of channels currently driven by a compare unit
+byte                        oc_chan   [2];      // channel attached to each compare unit
+unsigned int                list_data  [LISTLEN];  // tick deltas between edges, bit 15 set = upper 15 bits of a 31-bit delta, lower 16 bits follow
+byte                        list_len   [NCHAN];    // words used, the lists of all channels are packed into list_data in channel order
+byte                        list_base  [NCHAN];    // index of the first word, see list_index()
+byte                        list_edges [NCHAN];    // timestamps uploaded, always even
+byte                        list_first [NCHAN];    // words taken by the first delta, which goes to k_delay
+byte                        list_pos   [NCHAN];    // index of the next delta while running
 
 #ifdef LAN
 EthernetServer server(PORT);
@@ -64,25 +168,42 @@ void setup()
     wdt_disable();  // just in case the bootloader does not do this automatically
 
     EEPROM.get(EPA_SCPI, scpi);
+    list_load();
 
     pinMode(conf_clock_pin, INPUT);
+    scpi_lat_auto = 0;
     update_clock();  // also initialize scpi_clock_freq
 
+    N_port = 0;
     for (int n = 0; n < NCHAN; n++)
     {
+        int p = 0;
+        while (p < N_port && port_addr[p] != conf_pulse_port[n]) { p++; }
+        if (p == N_port) { port_addr[N_port++] = conf_pulse_port[n]; }
+        port_idx[n] = p;
+
+        if (conf_pulse_oc[n] > 0) { oc_chan[conf_pulse_oc[n] - 1] = n; }
+
         pinMode(conf_pulse_pin[n], OUTPUT);
         update_pulse(n);  // also initialize scpi_pulse_valid[n]
     }
 
     pinMode(conf_trig_pin, INPUT);
+    scpi_conf_auto  = 1;
+    scpi_conf_dirty = 0;
     scpi_trig_count = 0;
     scpi_trig_armed = scpi.trig_rearm;
     update_trig_ready();  // also initialize scpi_trig_ready
     update_trig_edge();  // actually configure interrupt
 
-    Serial.begin(9600);
+    update_baud();
 
 #ifdef LAN
+    for (int n = 0; n < NCHAN; n++)
+    {
+        if (conf_pulse_port[n] == conf_lan_cs_port) { SPI.usingInterrupt(255); }  // see conf_lan_cs_port
+    }
+
     SCPI_LAN scpi_lan;
     EEPROM.get(EPA_SCPI_LAN, scpi_lan);
 
@@ -104,22 +225,22 @@ void setup()
 
 void loop()
 {
+    meas_update();  // before commands, so :CLOCK:FREQuency:MEASure? sees the latest gate
+
     if (Serial.available() > 0)
     {
         lan = 0;  // receive/send via Serial
-        char msg[MSGLEN];
-        if (recv_msg(msg)) { parse_msg(msg); }
+        if (recv_msg(line_serial)) { parse_compound(line_serial.msg, parse_msg); skip_block(); send_flush(); }  // one message per loop
     }
 
 #ifdef LAN
     if (scpi_lan_mode != LAN_OFF)
     {
-        client = server.available();
+        client = recv_client(server);
         if (client)
         {
             lan = 1;  // receive/send via client
-            char msg[MSGLEN];
-            if (recv_msg(msg)) { parse_msg(msg); }
+            if (recv_msg(line_lan)) { parse_compound(line_lan.msg, parse_msg); skip_block(); send_flush(); }
         }
     }
 
@@ -145,65 +266,318 @@ void run_hw_trig()
     c_cur = TCNT1;        // TESTING: read as early as possible to make global timebase as accurate as possible
     if (scpi_trig_ready)  // TESTING: precalculated to save a bit of time
     {
-        gen_pulses();
-        scpi_trig_armed = scpi.trig_rearm;
-        update_trig_ready();
+        seq_start(1);
     }
     scpi_trig_count++;
 }
 
 void run_sw_trig()  // subset of run_hw_trig() ignoring armed/disarmed and trigger count
 {
+    noInterrupts();
     c_cur = TCNT1;
-    if (N_active > 0)
+    if ((N_active > 0 || oc_active != 0) && !seq_running)
     {
-        gen_pulses();
-        update_trig_ready();
+        seq_start(0);
     }
+    interrupts();
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+    run_edges();
+}
+
+ISR(TIMER1_COMPB_vect)
+{
+    oc_edge(oc_chan[0]);
 }
 
-void gen_pulses()
+ISR(TIMER1_COMPC_vect)
 {
-    for (int n = 0; n < NCHAN; n++)  // TESTING: quick iteration to accelerate short delays
+    oc_edge(oc_chan[1]);
+}
+
+ISR(TIMER3_COMPA_vect)  // every conf_meas_tick_us, latches Timer1 every meas_gate_ticks, the 64-bit work is left to meas_update()
+{
+    const unsigned int c1 = TCNT1;  // read together, TCNT3 then holds the interrupt latency, which is corrected for
+    const unsigned int c3 = TCNT3;
+    if (++meas_tick < meas_gate_ticks) { return; }
+    meas_tick = 0;
+
+    uint32_t ovf = c_ovf;
+    if ((TIFR1 & bit(TOV1)) && c1 < 0x8000) { ovf++; }  // as in extend_tcnt1()
+    meas_c1  = c1;
+    meas_ovf = ovf;
+    meas_c3  = c3;
+    meas_gates++;
+}
+
+ISR(TIMER1_OVF_vect)
+{
+    c_ovf++;
+    if (seq_running)  // arm compare units once the next edge is less than one wrap away
     {
-        if (k_cur >= k_next[n])  // use x_next[n] == 1 below:
+        run_edges();
+        for (int n = 0; n < NCHAN; n++)
         {
-            pulse_write(n, !scpi.pulse_invert[n]);
-
-            k_next[n] += k_width[n];
-            x_next[n] = 0;
+            if (((oc_active >> n) & 0x1) && !(TIMSK1 & bit(oc_ocie[conf_pulse_oc[n] - 1]))) { oc_arm(n); }
         }
     }
-    
+}
+
+unsigned long long extend_tcnt1(const unsigned int c)  // call with interrupts disabled, c must be read from TCNT1 shortly before
+{
+    uint32_t ovf = c_ovf;
+    if ((TIFR1 & bit(TOV1)) && c < 0x8000) { ovf++; }  // wrapped, but TIMER1_OVF not yet serviced
+    return ((unsigned long long)ovf << 16) | c;
+}
+
+void seq_start(const bool hw)  // call with interrupts disabled, edge queue already prepared by update_trig_ready()
+{
     scpi_trig_ready = 0;  // ok to set now  TODO: test against spurious triggers
+    seq_running = 1;
+    seq_hw = hw;
+    lat_entry   = extend_tcnt1(c_cur);
+    lat_pending = hw;
+    t_start = lat_entry - k_start;  // account for interrupt processing time
+
+    for (int n = 0; n < NCHAN; n++)
+    {
+        if ((oc_active >> n) & 0x1)
+        {
+            const byte u = conf_pulse_oc[n] - 1;
+            oc_action(u, bank->invert[n]);  // latch inactive level before handing pin over to the compare unit
+            TCCR1C = bit(oc_foc[u]);
+            oc_arm(n);
+        }
+    }
 
+    if (hw)  // with scpi_lat_auto, later sequences start once edges can be written, so DELay 0 is not late
+    {
+        const unsigned int k_ready = extend_tcnt1(TCNT1) - lat_entry;
+        k_ready_peak -= k_ready_peak >> 4;  // a single outlier fades within a few dozen triggers instead of delaying all later ones
+        if (k_ready > k_ready_peak) { k_ready_peak = k_ready; }
+        if (scpi_lat_auto)          { k_start = -(long)k_ready_peak; }
+    }
+    run_edges();
+}
+
+void seq_abort()
+{
+    noInterrupts();
+    if (seq_running)
+    {
+        for (int n = 0; n < NCHAN; n++) { pulse_write(n, bank->invert[n]); }
+        TCCR1A &= ~((0x3 << COM1B0) | (0x3 << COM1C0));  // compare unit pins revert to (inactive) port value
+        TIMSK1 &= ~(bit(OCIE1B) | bit(OCIE1C));
+        oc_active = 0;
+        N_active  = 0;
+        seq_done();
+    }
+    interrupts();
+}
+
+void seq_done()
+{
+    TIMSK1 &= ~bit(OCIE1A);
+    seq_running = 0;
+    if (seq_hw)
+    {
+        scpi_trig_armed = scpi.trig_rearm;
+        if (scpi_seq_length > 0) { scpi_seq_index = (scpi_seq_index + 1) % scpi_seq_length; }
+    }
+    update_trig_ready();
+}
+
+void run_edges()  // call with interrupts disabled, returns once next edge is scheduled or sequence is done
+{
     while (1)
     {
-        unsigned int c_diff = TCNT1 - c_cur;
-        c_cur += c_diff;
-        k_cur += c_diff;
+        k_cur = (extend_tcnt1(TCNT1) - t_start) & K_MASK;
+
+        if (N_active == 0)
+        {
+            TIMSK1 &= ~bit(OCIE1A);
+            if (oc_active == 0) { seq_done(); }
+            return;
+        }
+
+        const byte n = q_chan[N_active - 1];
+        const long long k_diff = k_next[n] - k_cur;
 
-        for (int n = 0; n < NCHAN; n++)  // full loop
+        if (k_diff <= 0) { run_instant(); }  // due (or late)
+        else if (k_diff >= k_lead)  // far enough ahead to schedule
+        {
+            if (k_diff <= 0xFFFF)  // within one wrap, otherwise TIMER1_OVF calls back
+            {
+                OCR1A  = (unsigned int)t_start + (unsigned int)k_next[n];  // lower 16 bits of absolute time
+                TIFR1  = bit(OCF1A);  // clear stale match, if any
+                TIMSK1 |= bit(OCIE1A);
+            }
+            else { TIMSK1 &= ~bit(OCIE1A); }
+            return;
+        }
+    }
+}
+
+void oc_edge(const byte n)  // compare unit has just written the edge of channel n
+{
+    if (next_edge(n)) { oc_arm(n); }
+    else              { oc_done(n); }
+}
+
+void oc_arm(const byte n)  // program compare unit for the next edge of channel n, call with interrupts disabled
+{
+    const byte u = conf_pulse_oc[n] - 1;
+
+    while (1)
+    {
+        const long long k_diff = k_next[n] - ((extend_tcnt1(TCNT1) - t_start) & K_MASK);
+
+        if (k_diff <= 0)  // due (or late), force the compare action
+        {
+            oc_action(u, x_next[n] != bank->invert[n]);
+            TCCR1C = bit(oc_foc[u]);
+            if (!next_edge(n))
+            {
+                oc_done(n);
+                return;
+            }
+        }
+        else if (k_diff >= k_lead)
         {
-            if (k_cur >= k_next[n])
+            if (k_diff <= 0xFFFF)  // within one wrap, otherwise TIMER1_OVF calls back and the previous (idempotent) action stays in place
             {
-                pulse_write(n, x_next[n] ? !scpi.pulse_invert[n] : scpi.pulse_invert[n]);
-
-                k_next[n] += x_next[n] ? k_width[n] : (k_period[n] - k_width[n]);
-                x_next[n] = !x_next[n];
-
-                if (k_next[n] >= k_end[n])
-                {
-                    pulse_write(n, scpi.pulse_invert[n]);
-                    k_next[n] = 4100000000;
-                    N_active--;
-                    if (N_active == 0) { return; }
-                }
+                oc_action(u, x_next[n] != bank->invert[n]);
+                *oc_ocr[u] = (unsigned int)t_start + (unsigned int)k_next[n];
+                TIFR1  = bit(oc_ocf[u]);
+                TIMSK1 |= bit(oc_ocie[u]);
             }
+            else { TIMSK1 &= ~bit(oc_ocie[u]); }
+            return;
         }
     }
 }
 
+void oc_action(const byte u, const bool x)  // set (x = 1) or clear (x = 0) output on compare match
+{
+    TCCR1A = (TCCR1A & ~(0x3 << oc_com0[u])) | ((x ? 0x3 : 0x2) << oc_com0[u]);
+}
+
+void oc_done(const byte n)
+{
+    const byte u = conf_pulse_oc[n] - 1;
+
+    TIMSK1 &= ~bit(oc_ocie[u]);
+    TCCR1A &= ~(0x3 << oc_com0[u]);  // pin reverts to port value, which is the inactive level
+    oc_active &= ~(1 << n);
+
+    if (N_active == 0 && oc_active == 0) { seq_done(); }
+}
+
+void run_instant()  // write all edges of the next instant, then requeue their channels and prepare the following instant
+{
+    for (int p = 0; p < N_port; p++)
+    {
+        if (port_set[p] | port_clr[p]) { *port_addr[p] = (*port_addr[p] & ~port_clr[p]) | port_set[p]; }
+    }
+    const unsigned long long k = k_next[q_chan[N_active - 1]];
+    if (lat_pending) { lat_record(((extend_tcnt1(TCNT1) - lat_entry) & K_MASK) - k); }  // less the DELay, so only lateness is left
+    while (N_active > 0 && k_next[q_chan[N_active - 1]] == k)
+    {
+        N_active--;
+        const byte n = q_chan[N_active];
+        if (next_edge(n)) { queue_insert(n); }  // never requeued at k, since k_width > 0 and k_period > k_width unless finishing
+    }
+
+    prepare_instant();
+}
+
+void prepare_instant()  // collect edges at the queue head into per-port set/clear masks
+{
+    for (int p = 0; p < N_port; p++)
+    {
+        port_set[p] = 0;
+        port_clr[p] = 0;
+    }
+
+    for (int i = N_active - 1; i >= 0 && k_next[q_chan[i]] == k_next[q_chan[N_active - 1]]; i--)
+    {
+        const byte n = q_chan[i];
+        if (x_next[n] != bank->invert[n]) { port_set[port_idx[n]] |= conf_pulse_mask[n]; }
+        else                              { port_clr[port_idx[n]] |= conf_pulse_mask[n]; }
+    }
+}
+
+bool next_edge(const byte n)  // advance k_next[n] past the edge just written, returns 0 once channel is finished
+{
+    if (bank->mode[n] == MODE_LIST)
+    {
+        if (list_pos[n] == list_base[n] + list_len[n]) { return 0; }  // even number of edges, so the last one was inactive
+        k_next[n] += list_delta(list_pos[n]);
+        x_next[n] = !x_next[n];
+    }
+    else if (x_next[n])
+    {
+        k_next[n] += bank->k_width[n];
+        x_next[n] = (bank->k_width[n] == bank->k_period[n] && k_next[n] < bank->k_end[n]);  // continuous: skip all but the final inactive edge
+    }
+    else
+    {
+        k_next[n] += bank->k_period[n] - bank->k_width[n];
+        x_next[n] = 1;
+        if (k_next[n] >= bank->k_end[n]) { return 0; }
+    }
+    return 1;
+}
+
+void queue_insert(const byte n)  // insertion sort, ties keep insertion order
+{
+    int i = N_active;
+    while (i > 0 && k_next[q_chan[i - 1]] <= k_next[n])
+    {
+        q_chan[i] = q_chan[i - 1];
+        i--;
+    }
+    q_chan[i] = n;
+    N_active++;
+}
+
+unsigned long list_delta(byte &pos)  // decode delta at word pos, advancing pos past it
+{
+    const unsigned int w = list_data[pos++];
+    if (w & 0x8000) { return ((unsigned long)(w & 0x7FFF) << 16) | list_data[pos++]; }
+    return w;
+}
+
+void lat_record(const long long d)  // ticks from run_hw_trig() entry plus the edge's sequence time to the port write
+{
+    const unsigned int k = (d < 0) ? 0 : (d > 0xFFFF) ? 0xFFFF : d;  // early (start offset too large) counts as 0, saturates instead of wrapping
+
+    lat_pending = 0;
+    lat_count++;
+    lat_sum += k;
+    if (k < lat_min) { lat_min = k; }
+    if (k > lat_max) { lat_max = k; }
+
+    byte b = 0;
+    for (unsigned int x = k; x > 0 && b < NBIN - 1; x >>= 1) { b++; }
+    lat_hist[b]++;
+}
+
+void lat_clear()
+{
+    noInterrupts();
+    lat_count   = 0;
+    lat_sum     = 0;
+    lat_min     = 0xFFFF;
+    lat_max     = 0;
+    k_ready_peak = 0;
+    for (int b = 0; b < NBIN; b++) { lat_hist[b] = 0; }
+    k_start = scpi_lat_auto ? 0 : (scpi_clock_freq * conf_start_us) / 1000000;
+    interrupts();
+}
+
 void pulse_write(const int n, const bool x)  // TESTING: a bit quicker than digitalWrite()
 {
     if (x) { *conf_pulse_port[n] |=  conf_pulse_mask[n]; }
@@ -212,54 +586,255 @@ void pulse_write(const int n, const bool x)  // TESTING: a bit quicker than digi
 
 // runtime update functions:
 
-bool update_clock()
+void update_clock()
 {
     scpi_clock_freq = (scpi.clock_src == INTERNAL) ? conf_clock_freq_int : scpi.clock_freq_ext;
+    k_lead  = max((scpi_clock_freq * conf_lead_us) / 1000000, 1);
+    lat_clear();  // latency in ticks depends on clock, also sets k_start
 
     TCCR1A = 0x0;                                  // COM1A1=0 COM1A0=0 COM1B1=0 COM1B0=0 FOC1A=0 FOC1B=0 WMG11=0 WGM10=0
     TCCR1B = (scpi.clock_src == INTERNAL) ? 0x2 :  // ICNC1=0  ICES1=0  n/a=0    WGM13=0  WGM12=0 CS12=0  CS11=1  CS10=0  (internal, /8)
              (scpi.clock_edge == RISING)  ? 0x7 :  // ICNC1=0  ICES1=0  n/a=0    WGM13=0  WGM12=0 CS12=1  CS11=1  CS10=1  (external, rising)
                                             0x6;   // ICNC1=0  ICES1=0  n/a=0    WGM13=0  WGM12=0 CS12=1  CS11=1  CS10=0  (external, falling)
+    TIMSK1 = bit(TOIE1);                           // overflow interrupt extends TCNT1 to 48 bits, compare interrupt only while sequence runs
+    update_meas();  // counts of the previous clock are meaningless now
+}
+
+void update_meas()
+{
+    noInterrupts();
+    meas_gate_ticks = max(scpi.clock_gate / conf_meas_tick_us, 1);
+    meas_tick   = 0;
+    meas_gates  = 0;
+    meas_i      = 0;
+    meas_n      = 0;
+    meas_primed = 0;
+
+    TCCR3A = 0x0;                                              // COM3A1=0 COM3A0=0 COM3B1=0 COM3B0=0 COM3C1=0 COM3C0=0 WGM31=0 WGM30=0
+    TCCR3B = 0xA;                                              // ICNC3=0  ICES3=0  n/a=0    WGM33=0  WGM32=1  CS32=0   CS31=1  CS30=0  (CTC, /8)
+    OCR3A  = (conf_meas_freq / 1000) * conf_meas_tick_us / 1000 - 1;
+    TCNT3  = 0;
+    TIMSK3 = bit(OCIE3A);
+    interrupts();
+}
+
+void meas_update()  // closes the gate latched last, gates missed by a busy loop() are merged into it
+{
+    noInterrupts();
+    const unsigned int gates = meas_gates;
+    const unsigned int c1    = meas_c1;
+    const uint32_t     ovf   = meas_ovf;
+    const unsigned int c3    = meas_c3;
+    meas_gates = 0;
+    interrupts();
+
+    if (gates == 0) { return; }
+
+    const unsigned long long k = ((unsigned long long)ovf << 16) | c1;
+    if (meas_primed)
+    {
+        meas_k[meas_i] = k - meas_k_prev;
+        meas_t[meas_i] = (unsigned long)gates * meas_gate_ticks * (OCR3A + 1) + c3 - meas_c3_prev;
+        meas_i = (meas_i + 1) % NGATE;
+        if (meas_n < NGATE) { meas_n++; }
+    }
+    meas_primed  = 1;
+    meas_k_prev  = k;
+    meas_c3_prev = c3;
+}
+
+long long meas_freq(const byte j)  // frequency in mHz of ring entry j
+{
+    return ((unsigned long long)meas_k[j] * conf_meas_freq * 1000 + meas_t[j] / 2) / meas_t[j];
 }
 
 void update_trig_edge()
 {
-    attachInterrupt(digitalPinToInterrupt(conf_trig_pin), run_null,    scpi.trig_edge);
-    delay(100);  // let possibly lingering interrupt clear out
+    noInterrupts();
     attachInterrupt(digitalPinToInterrupt(conf_trig_pin), run_hw_trig, scpi.trig_edge);
+    EIFR = bit(conf_trig_intf);  // discard edge latched under the old setting or by changing the sense bits
+    interrupts();
+}
+
+bool update_config(const byte dirty)  // recompute only what changed (bits as in scpi_conf_dirty), then requeue first edges once
+{
+    bool ok = 1;
+    if ((dirty >> NCHAN) & 0x1) { update_clock(); update_slots(); }
+    for (int n = 0; n < NCHAN; n++) { if (((dirty >> n) & 0x1) && !update_pulse(n)) { ok = 0; } }  // at least one channel might be not ok . . .
+    update_trig_ready();
+
+    scpi_conf_dirty &= ~dirty;
+    return ok;
+}
+
+void update_or_defer(const byte dirty)  // replies for the caller
+{
+    if (!scpi_conf_auto)
+    {
+        scpi_conf_dirty |= dirty;
+        send_str("OK");
+    }
+    else if (update_config(dirty)) { send_str("OK");            }
+    else                           { send_eps(EPA_REPLY_CHECK); }
 }
 
 bool update_pulse(const int n)
 {
-    pulse_write(n, scpi.pulse_invert[n]);  // if inverting, then set initial value HIGH	
+    scpi_pulse_valid[n] = bank_pulse(bank_live, n, pulse_get(n), scpi_pulse_error[n]);
+    return scpi_pulse_valid[n];
+}
+
+void update_slots()  // recompute stored slots for the current clock (and edge lists)
+{
+    long error;
+    for (int i = 0; i < NSLOT; i++) { for (int n = 0; n < NCHAN; n++) { bank_pulse(bank_slot[i], n, slot_pulse[i][n], error); } }
+}
+
+void slot_store(const int i)  // :SEQuence:STORe, no changes pending, so scpi holds the settings of bank_live
+{
+    bank_slot[i] = bank_live;
+    for (int n = 0; n < NCHAN; n++) { slot_pulse[i][n] = pulse_get(n); }
+}
+
+PULSE pulse_get(const int n)  // settings of channel n, as committed unless changes are pending
+{
+    const PULSE p = {scpi.pulse_delay[n], scpi.pulse_width[n], scpi.pulse_period[n], scpi.pulse_cycles[n],
+                     scpi.pulse_mode[n],  scpi.pulse_invert[n], scpi.pulse_drive[n]};
+    return p;
+}
+
+bool bank_pulse(BANK &b, const int n, const PULSE &p, long &error)  // precompute channel n of b, returns whether it is valid
+{
+    b.mode[n]   = p.mode;
+    b.invert[n] = p.invert;  // taken from the bank while running, so INVert and DRIVe wait for a commit like the timing
+    b.drive[n]  = p.drive;
+
+    if (b.mode[n] == MODE_LIST)  // timestamps are already in ticks, at most LISTLEN*2^31 in total
+    {
+        byte pos = list_base[n];
+        b.k_delay[n]  = (list_len[n] > 0) ? list_delta(pos) : 0;
+        list_first[n] = pos - list_base[n];
+        error = 0;
+        b.active[n] = (list_len[n] > 0);
+        return b.active[n];
+    }
+
+    long long e_delay, e_width, e_period;
+    b.k_delay[n]  = micros_to_ticks(p.delay,                e_delay);
+    b.k_width[n]  = micros_to_ticks(min(p.width, p.period), e_width);
+    b.k_period[n] = micros_to_ticks(p.period,               e_period);
+
+    const unsigned long long cycles = p.cycles;
+    const bool valid = (b.k_width[n] > 0) &&  // sub-tick pulses are not representable
+                       ((cycles == 0) || (b.k_period[n] <= (K_MAX - b.k_delay[n]) / cycles)) &&  // k_delay alone is always well below K_MAX
+                       ((cycles <= 1) || (b.k_width[n] == b.k_period[n]) ||  // otherwise edges closer than k_lead on both sides would be polled
+                        (max(b.k_width[n], b.k_period[n] - b.k_width[n]) >= k_lead));  // by the edge interrupt for the whole train
+    b.k_end[n]  = valid ? b.k_delay[n] + b.k_period[n] * cycles : b.k_delay[n];
+    b.active[n] = valid && (cycles > 0);
+
+    long long e_end = (e_delay + e_period * (long long)cycles) * 1000 / scpi_clock_freq;  // in ns, cannot overflow for valid long inputs
+    error = (e_end > 0x7FFFFFFF) ? 0x7FFFFFFF : (e_end < -0x7FFFFFFF) ? -0x7FFFFFFF : e_end;
 
-    float scpi_clock_freq_MHz = float(scpi_clock_freq) / 1e6;
+    return valid;
+}
 
-    k_delay[n]  = scpi_clock_freq_MHz * scpi.pulse_delay[n];
-    k_width[n]  = scpi_clock_freq_MHz * min(scpi.pulse_width[n], scpi.pulse_period[n]);
-    k_period[n] = scpi_clock_freq_MHz * scpi.pulse_period[n];
-    k_end[n]    = k_delay[n] + k_period[n] * scpi.pulse_cycles[n];
+long ticks_to_ns(const long k)
+{
+    return ((long long)k * 1000000000) / scpi_clock_freq;
+}
+
+unsigned long long micros_to_ticks(const long us, long long &err)  // exact, rounds to nearest tick, err is in units of 1e-6 ticks
+{
+    const unsigned long long x = (unsigned long long)us * scpi_clock_freq;  // us >= 0, product < 2^55
+    const unsigned long long k = (x + 500000) / 1000000;
 
-    return scpi_pulse_valid[n] = (scpi_clock_freq_MHz * (float(scpi.pulse_delay[n]) + float(scpi.pulse_period[n]) * scpi.pulse_cycles[n]) < 4e9);  // calculate with floats
+    err = (long long)(k * 1000000) - (long long)x;
+    return k;
 }
 
 void update_trig_ready()
 {
-    k_cur = (scpi_clock_freq * conf_start_us) / 1000000;  // account for interrupt processing time
-    N_active = 0;
+    const byte sreg = SREG;  // also called from seq_done(), so restore rather than re-enable interrupts
+    noInterrupts();
 
-    for (int n = 0; n < NCHAN; n++)
+    N_active  = 0;
+    oc_active = 0;
+    bank = (scpi_seq_length > 0) ? &bank_slot[scpi_seq_index] : &bank_live;
+
+    for (int n = 0; n < NCHAN; n++)  // presort first edges
     {
-        if (scpi_pulse_valid[n] && (scpi.pulse_cycles[n] > 0))
+        pulse_write(n, bank->invert[n]);  // if inverting, then set initial value HIGH
+
+        if (bank->active[n])
         {
-            N_active++;
-            k_next[n] = k_delay[n];
-            x_next[n] = 1;
+            k_next[n]   = bank->k_delay[n];
+            x_next[n]   = 1;
+            list_pos[n] = list_base[n] + list_first[n];
+
+            if (bank->drive[n] == DRIVE_HW && conf_pulse_oc[n] > 0) { oc_active |= 1 << n; }
+            else                                                    { queue_insert(n);    }
         }
-        else { k_next[n] = 4100000000; }
     }
+    prepare_instant();
+
+    scpi_trig_ready = scpi_trig_armed && (N_active > 0 || oc_active != 0);
+
+    SREG = sreg;
+}
+
+void list_load()
+{
+    EEPROM.get(EPA_LIST_LEN,   list_len);
+    EEPROM.get(EPA_LIST_EDGES, list_edges);
+    EEPROM.get(EPA_LIST_DATA,  list_data);
+
+    int used = 0;
+    for (int n = 0; n < NCHAN; n++) { used += list_len[n]; }
+    if (used > LISTLEN) { list_clear(); }  // EEPROM not (yet) initialized
+    list_index();
+}
+
+void list_save()
+{
+    EEPROM.put(EPA_LIST_LEN,   list_len);
+    EEPROM.put(EPA_LIST_EDGES, list_edges);
+    EEPROM.put(EPA_LIST_DATA,  list_data);
+}
+
+void list_clear()  // all channels
+{
+    for (int n = 0; n < NCHAN; n++)
+    {
+        list_len[n]   = 0;
+        list_edges[n] = 0;
+    }
+    list_index();
+}
+
+void list_index()  // each list starts where the one of the previous channel ends
+{
+    byte base = 0;
+    for (int n = 0; n < NCHAN; n++)
+    {
+        list_base[n] = base;
+        base += list_len[n];
+    }
+}
+
+void list_move(const byte dst, const byte src, const byte len)  // words within list_data, ranges may overlap
+{
+    memmove(&list_data[dst], &list_data[src], len * sizeof(list_data[0]));
+}
+
+void update_baud()
+{
+    long baud;
+    EEPROM.get(EPA_SERIAL_BAUD, baud);
+    if (baud < 300 || baud > 2000000) { baud = 9600; }  // e.g. EEPROM not yet initialized
 
-    scpi_trig_ready = scpi_trig_armed && N_active > 0;
+    Serial.flush();  // pending output at the old rate
+    Serial.end();
+    Serial.begin(baud);
 }
 
 void update_lan()
@@ -282,40 +857,55 @@ void update_lan()
 
 void parse_msg(const char *msg)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"*IDN", "*TRG", "*SAV", "*RCL", "*RST", ":CLOCK", ":TRIGger", ":PULSe#", ":ABORt", ":SEQuence", ":CONFigure", ":DIAGnostic", ":SYSTem"};
+    enum                                       { K_IDN,  K_TRG,  K_SAV,  K_RCL,  K_RST,  K_CLOCK,  K_TRIG,     K_PULS,    K_ABOR,   K_SEQ,       K_CONF,       K_DIAG,        K_SYST };
     bool update = 0;
+    int n;
 
-    if (equal(msg, "*IDN?"))
-    {
-        unsigned long eeprom_commit;
-        EEPROM.get(EPA_COMMIT, eeprom_commit);
-
-        send_eps(EPA_IDN,       NOEOL);
-        send_str(" (PROG: ",    NOEOL);
-        send_hex(conf_commit,   NOEOL);
-        send_str(", EEPROM: ",  NOEOL);
-        send_hex(eeprom_commit, NOEOL);
-        send_str(")");
-    }
-    else if (equal(msg, "*TRG"))                    { send_str("OK"); run_sw_trig();              }  // reply first, in case pulse sequence is longer than client's serial timeout
-    else if (equal(msg, "*SAV"))                    { EEPROM.put(EPA_SCPI, scpi); send_str("OK"); }
-    else if (equal(msg, "*RCL"))                    { EEPROM.get(EPA_SCPI, scpi); update = 1;     }
-    else if (equal(msg, "*RST"))                    { scpi_default(scpi);         update = 1;     }
-    else if (start(msg, ":CLOCK:",           rest)) { parse_clock(rest);                          }
-    else if (start(msg, ":TRIG", "ger", ":", rest)) { parse_trig(rest);                           }
-    else if (start(msg, ":PULS", "e",  "1:", rest)) { parse_pulse(0, rest);                       }
-    else if (start(msg, ":PULS", "e",  "2:", rest)) { parse_pulse(1, rest);                       }
-    else if (start(msg, ":PULS", "e",  "3:", rest)) { parse_pulse(2, rest);                       }
-    else if (start(msg, ":PULS", "e",  "4:", rest)) { parse_pulse(3, rest);                       }
-    else if (start(msg, ":SYST", "em",  ":", rest)) { parse_system(rest);                         }
-    else                                            { send_eps(EPA_REPLY_INVALID_CMD);            }
+    if (seq_running && seq_locked(msg)) { send_eps(EPA_REPLY_BUSY); return; }
 
-    if (update)
+    switch (parse_key(msg, keys, n))
+    {
+        case K_IDN | QUERY:
+        {
+            unsigned long eeprom_commit;
+            EEPROM.get(EPA_COMMIT, eeprom_commit);
+
+            send_eps(EPA_IDN,       NOEOL);
+            send_str(" (PROG: ",    NOEOL);
+            send_hex(conf_commit,   NOEOL);
+            send_str(", EEPROM: ",  NOEOL);
+            send_hex(eeprom_commit, NOEOL);
+            send_str(")");
+            break;
+        }
+        case K_TRG | BARE: send_str("OK"); run_sw_trig();                           break;  // reply first, so the reply is not delayed by edge interrupts
+        case K_SAV | BARE: EEPROM.put(EPA_SCPI, scpi); list_save(); send_str("OK"); break;
+        case K_RCL | BARE: EEPROM.get(EPA_SCPI, scpi); list_load(); update = 1;     break;
+        case K_RST | BARE:
+            scpi_default(scpi);
+            list_clear();
+            scpi_seq_length = 0;
+            scpi_seq_index  = 0;
+            update = 1;
+            break;
+        case K_CLOCK | NODE: parse_clock(msg); break;
+        case K_TRIG  | NODE: parse_trig(msg);  break;
+        case K_PULS  | NODE:
+            if (n >= 1 && n <= NCHAN) { parse_pulse(n - 1, msg);          }
+            else                      { send_eps(EPA_REPLY_INVALID_CMD); }
+            break;
+        case K_ABOR | BARE: seq_abort(); send_str("OK"); break;
+        case K_SEQ  | NODE: parse_seq(msg);              break;
+        case K_CONF | NODE: parse_conf(msg);             break;
+        case K_DIAG | NODE: parse_diag(msg);             break;
+        case K_SYST | NODE: parse_system(msg);           break;
+        default:            send_eps(EPA_REPLY_INVALID_CMD);
+    }
+
+    if (update)  // settings were replaced as a whole, so applied immediately
     {
-        update_clock();
-        bool ok = 1;
-        for (int n = 0; n < NCHAN; n++) { if (!update_pulse(n)) { ok = 0; } }  // at least one channel might be not ok . . .
-        update_trig_ready();
+        bool ok = update_config(DIRTY_ALL);
         update_trig_edge();
 
         if (ok) { send_str("OK");            }
@@ -323,218 +913,513 @@ void parse_msg(const char *msg)
     }
 }
 
+bool seq_locked(const char *msg)  // commands that would modify the pulse sequence under a running engine
+{
+    static const char keys[][KEYLEN] PROGMEM = {"*TRG", "*RCL", "*RST", ":CLOCK", ":TRIGger", ":PULSe#", ":SEQuence", ":CONFigure"};
+
+    int len = strlen(msg);
+    if (len > 0 && msg[len - 1] == '?') { return 0; }  // queries are always ok
+
+    return parse_key(msg, keys) != NO_KEY;
+}
+
 void parse_clock(const char *msg)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"SRC", "EDGE", "FREQuency"};
+    enum                                       { K_SRC, K_EDGE, K_FREQ };
     bool update = 0;
 
-    if      (equal(msg, "SRC?"))                     { send_str(scpi.clock_src == INTERNAL ? "INTERNAL" : "EXTERNAL"); }
-    else if (start(msg, "SRC ", rest))
+    switch (parse_key(msg, keys))
     {
-        if      (equal(rest, "INT", "ernal"))        { scpi.clock_src = INTERNAL; update = 1;                          }
-        else if (equal(rest, "EXT", "ernal"))        { scpi.clock_src = EXTERNAL; update = 1;                          }
-        else                                         { send_eps(EPA_REPLY_INVALID_ARG);                                }
-
+        case K_SRC | QUERY: send_str(scpi.clock_src == INTERNAL ? "INTERNAL" : "EXTERNAL"); break;
+        case K_SRC | SET:
+            if      (equal(msg, "INT", "ernal")) { scpi.clock_src = INTERNAL; update = 1; }
+            else if (equal(msg, "EXT", "ernal")) { scpi.clock_src = EXTERNAL; update = 1; }
+            else                                 { send_eps(EPA_REPLY_INVALID_ARG);       }
+            break;
+        case K_EDGE | QUERY: send_str(scpi.clock_edge == RISING ? "RISING" : "FALLING"); break;
+        case K_EDGE | SET:   parse_edge(msg, scpi.clock_edge, update);                   break;
+        case K_FREQ | QUERY: send_int(scpi_clock_freq);                                  break;
+        case K_FREQ | SET:   send_eps(EPA_REPLY_READONLY);                               break;
+        case K_FREQ | NODE:  parse_clock_freq(msg, update);                              break;
+        default:             send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (start(msg, "EDGE", rest))               { parse_edge(rest, scpi.clock_edge, update);                      }
-    else if (equal(msg, "FREQ", "uency", "?"))       { send_int(scpi_clock_freq);                                      }
-    else if (start(msg, "FREQ", "uency", " ", rest)) { send_eps(EPA_REPLY_READONLY);                                   }
-    else if (start(msg, "FREQ", "uency", ":", rest)) { parse_clock_freq(rest, update);                                 }
-    else                                             { send_eps(EPA_REPLY_INVALID_CMD);                                }
 
-    if (update)
-    {
-        update_clock();
-        bool ok = 1;
-        for (int n = 0; n < NCHAN; n++) { if (!update_pulse(n)) { ok = 0; } }  // at least one channel might be not ok . . .
-        update_trig_ready();
+    if (update) { update_or_defer(DIRTY_ALL); }  // tick conversion of all channels depends on the clock
+}
 
-        if (ok) { send_str("OK");            }
-        else    { send_eps(EPA_REPLY_CHECK); }
-    }
+void parse_edge(const char *msg, byte &edge, bool &update)  // argument of :CLOCK:EDGE and :TRIGger:EDGE
+{
+    if      (equal(msg, "RIS", "ing"))  { edge = RISING;  update = 1;        }
+    else if (equal(msg, "FALL", "ing")) { edge = FALLING; update = 1;        }
+    else                                { send_eps(EPA_REPLY_INVALID_ARG); }
 }
 
-void parse_edge(const char *msg, byte &edge, bool &update)
+void parse_clock_freq(const char *msg, bool &update)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"MEASure", "INTernal", "EXTernal"};
+    enum                                       { K_MEAS,    K_INT,      K_EXT };
 
-    if      (equal(msg, "?"))                { send_str(edge == RISING ? "RISING" : "FALLING"); }
-    else if (start(msg, " ", rest))
+    switch (parse_key(msg, keys))
     {
-        if      (equal(rest, "RIS", "ing"))  { edge = RISING;  update = 1;                      }
-        else if (equal(rest, "FALL", "ing")) { edge = FALLING; update = 1;                      }
-        else                                 { send_eps(EPA_REPLY_INVALID_ARG);                 }
+        case K_MEAS | QUERY: send_meas_freq();              break;
+        case K_MEAS | SET:   send_eps(EPA_REPLY_READONLY);  break;
+        case K_MEAS | NODE:  parse_clock_meas(msg);         break;
+        case K_INT  | QUERY: send_int(conf_clock_freq_int); break;
+        case K_INT  | SET:   send_eps(EPA_REPLY_READONLY);  break;
+        case K_EXT  | QUERY: send_int(scpi.clock_freq_ext); break;
+        case K_EXT  | SET:
+            if (parse_hertz(msg, scpi.clock_freq_ext, 1, 5000000, DEF_CLOCK_FREQ_EXT)) { update = 1;                      }
+            else                                                                       { send_eps(EPA_REPLY_INVALID_ARG); }
+            break;
+        default: send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else                                     { send_eps(EPA_REPLY_INVALID_CMD);                 }
 }
 
-void parse_clock_freq(const char *msg, bool &update)
+void parse_clock_meas(const char *msg)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"GATE", "ADEV"};
+    enum                                       { K_GATE, K_ADEV };
+    long gate;
 
-    if (equal(msg, "MEAS", "ure", "?"))
+    switch (parse_key(msg, keys))
     {
-        unsigned long t = millis();
-        unsigned int  c = TCNT1;
-        long          k = 0;
+        case K_GATE | QUERY: send_micros(scpi.clock_gate); break;
+        case K_GATE | SET:
+            if (parse_micros(msg, gate, conf_meas_tick_us, 60000000, DEF_CLOCK_GATE))
+            {
+                scpi.clock_gate = gate;
+                update_meas();
+                send_str("OK");
+            }
+            else { send_eps(EPA_REPLY_INVALID_ARG); }
+            break;
+        case K_ADEV | QUERY: send_meas_adev();             break;
+        case K_ADEV | SET:   send_eps(EPA_REPLY_READONLY); break;
+        default:             send_eps(EPA_REPLY_INVALID_CMD);
+    }
+}
 
-        while (millis() - t <= conf_measure_ms)
-        {
-            unsigned int c_diff = TCNT1 - c;
-            c += c_diff;
-            k += c_diff;
-        }
+void send_meas_freq()  // last gate in Hz
+{
+    if (meas_n > 0) { send_int((meas_freq((meas_i + NGATE - 1) % NGATE) + 500) / 1000); }
+    else            { send_int(0);                                                       }  // first gate not yet closed
+}
 
-        send_int((1000 * k) / conf_measure_ms);
-    }
-    else if (start(msg, "MEAS", "ure",  " ", rest))         { send_eps(EPA_REPLY_READONLY);    }
-    else if (equal(msg, "INT", "ernal", "?"))               { send_int(conf_clock_freq_int);   }
-    else if (start(msg, "INT", "ernal", " ", rest))         { send_eps(EPA_REPLY_READONLY);    }
-    else if (equal(msg, "EXT", "ernal", "?"))               { send_int(scpi.clock_freq_ext);   }
-    else if (start(msg, "EXT", "ernal", " ", rest))
+void send_meas_adev()  // sqrt(<(y[j+1] - y[j])^2>/2) for consecutive gates, y relative to mean
+{
+    const byte i = meas_i;
+    const byte m = meas_n;
+
+    double sum = 0, sum2 = 0;
+    long long f_prev = 0;
+    for (byte c = 0; c < m; c++)
     {
-        if (parse_num(rest, scpi.clock_freq_ext, ZERO_NOK)) { update = 1;                      }
-        else                                                { send_eps(EPA_REPLY_INVALID_ARG); }
+        const long long f = meas_freq((i + NGATE - m + c) % NGATE);
+        if (c > 0) { sum2 += (double)(f - f_prev) * (f - f_prev); }
+        sum += f;
+        f_prev = f;
     }
-    else                                                    { send_eps(EPA_REPLY_INVALID_CMD); }
+    if (m > 1) { send_int(1e9 * sqrt(sum2 / (2 * (m - 1))) / (sum / m)); }
+    else       { send_int(0);                                            }  // needs two gates
 }
 
 void parse_trig(const char *msg)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"EDGE", "ARMed", "READY", "BUSY", "REARM", "COUNt"};
+    enum                                       { K_EDGE, K_ARM,   K_READY, K_BUSY, K_REARM, K_COUN };
     bool update = 0;
 
-    if      (start(msg, "EDGE", rest))           { parse_edge(rest, scpi.trig_edge, update); }
-    else if (equal(msg, "ARM", "ed", "?"))       { send_hex(scpi_trig_armed);                }
-    else if (start(msg, "ARM", "ed", " ", rest))
+    switch (parse_key(msg, keys))
     {
-        if      (equal(rest, "1"))               { scpi_trig_armed = 1; update = 1;          }
-        else if (equal(rest, "0"))               { scpi_trig_armed = 0; update = 1;          }
-        else                                     { send_eps(EPA_REPLY_INVALID_ARG);          }
+        case K_EDGE | QUERY: send_str(scpi.trig_edge == RISING ? "RISING" : "FALLING"); break;
+        case K_EDGE | SET:   parse_edge(msg, scpi.trig_edge, update);                   break;
+        case K_ARM  | QUERY: send_hex(scpi_trig_armed);                                 break;
+        case K_ARM  | SET:
+            if      (equal(msg, "1"))        { scpi_trig_armed = 1; update = 1;     }
+            else if (equal(msg, "0"))        { scpi_trig_armed = 0; update = 1;     }
+            else                             { send_eps(EPA_REPLY_INVALID_ARG);     }
+            break;
+        case K_READY | QUERY: send_hex(scpi_trig_ready);    break;
+        case K_READY | SET:   send_eps(EPA_REPLY_READONLY); break;
+        case K_BUSY  | QUERY: send_hex(seq_running);        break;
+        case K_BUSY  | SET:   send_eps(EPA_REPLY_READONLY); break;
+        case K_REARM | QUERY: send_hex(scpi.trig_rearm);    break;
+        case K_REARM | SET:
+            if      (equal(msg, "1"))        { scpi.trig_rearm = 1; send_str("OK"); }
+            else if (equal(msg, "0"))        { scpi.trig_rearm = 0; send_str("OK"); }
+            else                             { send_eps(EPA_REPLY_INVALID_ARG);     }
+            break;
+        case K_COUN | QUERY: send_int(scpi_trig_count);    break;
+        case K_COUN | SET:   send_eps(EPA_REPLY_READONLY); break;
+        default:             send_eps(EPA_REPLY_INVALID_CMD);
+    }
 
+    if (update)
+    {
+        update_trig_ready();  // always ok
+        update_trig_edge();   // always ok
+        send_str("OK");
     }
-    else if (equal(msg, "READY?"))               { send_hex(scpi_trig_ready);                }
-    else if (start(msg, "READY ", rest))         { send_eps(EPA_REPLY_READONLY);             }
-    else if (equal(msg, "REARM?"))               { send_hex(scpi.trig_rearm);                }
-    else if (start(msg, "REARM ", rest))
+}
+
+void parse_seq(const char *msg)
+{
+    static const char keys[][KEYLEN] PROGMEM = {"STORe", "LENgth", "INDex"};
+    enum                                       { K_STOR,  K_LEN,    K_IND };
+    bool update = 0;
+    long i;
+
+    switch (parse_key(msg, keys))
     {
-        if      (equal(rest, "1"))               { scpi.trig_rearm = 1; send_str("OK");      }
-        else if (equal(rest, "0"))               { scpi.trig_rearm = 0; send_str("OK");      }
-        else                                     { send_eps(EPA_REPLY_INVALID_ARG);          }
+        case K_STOR | SET:
+            if      (scpi_conf_dirty)                  { send_eps(EPA_REPLY_PENDING);                            }  // would store the committed rather than the queried settings
+            else if (parse_num(msg, i, 1, NSLOT))      { slot_store(i - 1);                          update = 1; }
+            else                                       { send_eps(EPA_REPLY_INVALID_ARG);                        }
+            break;
+        case K_LEN | QUERY: send_int(scpi_seq_length); break;
+        case K_LEN | SET:
+            if (parse_num(msg, i, 0, NSLOT))           { scpi_seq_length = i; scpi_seq_index = 0;    update = 1; }
+            else                                       { send_eps(EPA_REPLY_INVALID_ARG);                        }
+            break;
+        case K_IND | QUERY: send_int(scpi_seq_index + 1); break;
+        case K_IND | SET:
+            if (parse_num(msg, i, 1, scpi_seq_length)) { scpi_seq_index = i - 1;                     update = 1; }
+            else                                       { send_eps(EPA_REPLY_INVALID_ARG);                        }
+            break;
+        default: send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (equal(msg, "COUN", "t", "?"))       { send_int(scpi_trig_count);                }
-    else if (start(msg, "COUN", "t", " ", rest)) { send_eps(EPA_REPLY_READONLY);             }
-    else                                         { send_eps(EPA_REPLY_INVALID_CMD);          }
 
     if (update)
     {
         update_trig_ready();  // always ok
-        update_trig_edge();   // always ok
         send_str("OK");
     }
 }
 
-void parse_pulse(const int n, const char *msg)
+void parse_conf(const char *msg)
 {
-    char rest[MSGLEN];
-    bool update = 0;
+    static const char keys[][KEYLEN] PROGMEM = {"COMMit", "AUTO", "PENDing"};
+    enum                                       { K_COMM,   K_AUTO, K_PEND };
 
-    if      (equal(msg, "DEL", "ay", "?"))                      { send_micros(scpi.pulse_delay[n]);     }
-    else if (start(msg, "DEL", "ay", " ", rest))
+    switch (parse_key(msg, keys))
     {
-        if (parse_micros(rest, scpi.pulse_delay[n], ZERO_OK))   { update = 1;                           }
-        else                                                    { send_eps(EPA_REPLY_INVALID_ARG);      }
+        case K_COMM | BARE:
+            if (update_config(scpi_conf_dirty)) { send_str("OK");                                       }
+            else                                { send_eps(EPA_REPLY_CHECK);                            }
+            break;
+        case K_AUTO | QUERY: send_hex(scpi_conf_auto); break;
+        case K_AUTO | SET:
+            if      (equal(msg, "1"))           { scpi_conf_auto = 1; update_or_defer(scpi_conf_dirty); }  // commits pending changes
+            else if (equal(msg, "0"))           { scpi_conf_auto = 0; send_str("OK");                   }
+            else                                { send_eps(EPA_REPLY_INVALID_ARG);                      }
+            break;
+        case K_PEND | QUERY: send_hex(scpi_conf_dirty);    break;
+        case K_PEND | SET:   send_eps(EPA_REPLY_READONLY); break;
+        default:             send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (equal(msg, "WID", "th", "?"))                      { send_micros(scpi.pulse_width[n]);     }
-    else if (start(msg, "WID", "th", " ", rest))
+}
+
+void parse_diag(const char *msg)
+{
+    static const char keys[][KEYLEN] PROGMEM = {"LATency"};
+    enum                                       { K_LAT };
+
+    switch (parse_key(msg, keys))
     {
-        if (parse_micros(rest, scpi.pulse_width[n], ZERO_NOK))  { update = 1;                           }
-        else                                                    { send_eps(EPA_REPLY_INVALID_ARG);      }
+        case K_LAT | QUERY:
+        {
+            noInterrupts();
+            const long          count = lat_count;
+            const unsigned long sum   = lat_sum;
+            const unsigned int  k_min = lat_min;
+            const unsigned int  k_max = lat_max;
+            interrupts();
+
+            send_int(count, NOEOL);
+            if (count > 0)
+            {
+                send_str(",",                      NOEOL);
+                send_int(ticks_to_ns(k_min),       NOEOL);
+                send_str(",",                      NOEOL);
+                send_int(ticks_to_ns(sum / count), NOEOL);
+                send_str(",",                      NOEOL);
+                send_int(ticks_to_ns(k_max));
+            }
+            else { send_str(""); }
+            break;
+        }
+        case K_LAT | NODE: parse_lat(msg); break;
+        default:           send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (equal(msg, "PER", "iod", "?"))                     { send_micros(scpi.pulse_period[n]);    }
-    else if (start(msg, "PER", "iod", " ", rest))
+}
+
+void parse_lat(const char *msg)
+{
+    static const char keys[][KEYLEN] PROGMEM = {"HISTogram", "CLEar", "AUTO", "OFFSet"};
+    enum                                       { K_HIST,      K_CLE,   K_AUTO, K_OFFS };
+
+    switch (parse_key(msg, keys))
     {
-        if (parse_micros(rest, scpi.pulse_period[n], ZERO_NOK)) { update = 1;                           }
-        else                                                    { send_eps(EPA_REPLY_INVALID_ARG);      }
+        case K_HIST | QUERY:
+            for (int b = 0; b < NBIN - 1; b++)
+            {
+                send_int(lat_hist[b], NOEOL);
+                send_str(",",         NOEOL);
+            }
+            send_int(lat_hist[NBIN - 1]);
+            break;
+        case K_CLE  | BARE:  lat_clear(); send_str("OK"); break;
+        case K_AUTO | QUERY: send_hex(scpi_lat_auto);     break;
+        case K_AUTO | SET:
+            if      (equal(msg, "1"))        { scpi_lat_auto = 1; lat_clear(); send_str("OK"); }
+            else if (equal(msg, "0"))        { scpi_lat_auto = 0; lat_clear(); send_str("OK"); }
+            else                             { send_eps(EPA_REPLY_INVALID_ARG);                 }
+            break;
+        case K_OFFS | QUERY: send_int(ticks_to_ns(k_start)); break;
+        case K_OFFS | SET:   send_eps(EPA_REPLY_READONLY);   break;
+        default:             send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (equal(msg, "CYC", "les", "?"))                     { send_int(scpi.pulse_cycles[n]);       }
-    else if (start(msg, "CYC", "les", " ", rest))
+}
+
+void parse_pulse(const int n, const char *msg)
+{
+    static const char keys[][KEYLEN] PROGMEM = {"DELay", "WIDth", "PERiod", "CYCles", "DRIVe", "MODe", "LIST", "INVert", "VALid", "ERRor"};
+    enum                                       { K_DEL,   K_WID,   K_PER,    K_CYC,    K_DRIV,  K_MOD,  K_LIST, K_INV,    K_VAL,   K_ERR };
+    bool update = 0;
+
+    switch (parse_key(msg, keys))
     {
-        if (parse_num(rest, scpi.pulse_cycles[n], ZERO_OK))     { update = 1; }
-        else                                                    { send_eps(EPA_REPLY_INVALID_ARG);      }
+        case K_DEL | QUERY: send_micros(scpi.pulse_delay[n]); break;
+        case K_DEL | SET:
+            if (parse_micros(msg, scpi.pulse_delay[n],  0, NUM_MAX, DEF_PULSE_DELAY))    { update = 1;                      }
+            else                                                                         { send_eps(EPA_REPLY_INVALID_ARG); }
+            break;
+        case K_WID | QUERY: send_micros(scpi.pulse_width[n]); break;
+        case K_WID | SET:
+            if (parse_micros(msg, scpi.pulse_width[n],  1, NUM_MAX, DEF_PULSE_WIDTH))    { update = 1;                      }
+            else                                                                         { send_eps(EPA_REPLY_INVALID_ARG); }
+            break;
+        case K_PER | QUERY: send_micros(scpi.pulse_period[n]); break;
+        case K_PER | SET:
+            if (parse_micros(msg, scpi.pulse_period[n], 1, NUM_MAX, DEF_PULSE_PERIOD))   { update = 1;                      }
+            else                                                                         { send_eps(EPA_REPLY_INVALID_ARG); }
+            break;
+        case K_CYC | QUERY: send_int(scpi.pulse_cycles[n]); break;
+        case K_CYC | SET:
+            if (parse_num(msg, scpi.pulse_cycles[n],    0, NUM_MAX, DEF_PULSE_CYCLES(n))) { update = 1;                      }
+            else                                                                         { send_eps(EPA_REPLY_INVALID_ARG); }
+            break;
+        case K_DRIV | QUERY: send_str(scpi.pulse_drive[n] == DRIVE_HW ? "HW" : "SW"); break;
+        case K_DRIV | SET:
+            if      (equal(msg, "SW"))                             { scpi.pulse_drive[n] = DRIVE_SW; update = 1; }
+            else if (equal(msg, "HW") && conf_pulse_oc[n] > 0)     { scpi.pulse_drive[n] = DRIVE_HW; update = 1; }
+            else                                                   { send_eps(EPA_REPLY_INVALID_ARG);      }
+            break;
+        case K_MOD | QUERY: send_str(scpi.pulse_mode[n] == MODE_LIST ? "LIST" : "TRAIN"); break;
+        case K_MOD | SET:
+            if      (equal(msg, "TRAIN"))                          { scpi.pulse_mode[n] = MODE_TRAIN; update = 1; }
+            else if (equal(msg, "LIST"))                           { scpi.pulse_mode[n] = MODE_LIST;  update = 1; }
+            else                                                   { send_eps(EPA_REPLY_INVALID_ARG);      }
+            break;
+        case K_LIST | QUERY: send_list(n); break;
+        case K_LIST | SET:
+            if (equal(msg, "#") && recv_list(n))                   { update = 1;                           }
+            else                                                   { send_eps(EPA_REPLY_INVALID_ARG);      }
+            break;
+        case K_LIST | NODE: parse_list(n, msg);             break;
+        case K_INV | QUERY: send_hex(scpi.pulse_invert[n]); break;
+        case K_INV | SET:
+            if      (equal(msg, "1"))                              { scpi.pulse_invert[n] = 1; update = 1; }
+            else if (equal(msg, "0"))                              { scpi.pulse_invert[n] = 0; update = 1; }
+            else                                                   { send_eps(EPA_REPLY_INVALID_ARG);      }
+            break;
+        case K_VAL | QUERY: send_hex(scpi_pulse_valid[n]); break;
+        case K_VAL | SET:   send_eps(EPA_REPLY_READONLY);  break;
+        case K_ERR | QUERY: send_int(scpi_pulse_error[n]); break;
+        case K_ERR | SET:   send_eps(EPA_REPLY_READONLY);  break;
+        default:            send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (equal(msg, "INV", "ert", "?"))                     { send_hex(scpi.pulse_invert[n]);       }
-    else if (start(msg, "INV", "ert", " ", rest))
+
+    if (update) { update_or_defer(1 << n); }
+}
+
+void parse_list(const int n, const char *msg)
+{
+    static const char keys[][KEYLEN] PROGMEM = {"COUNt"};
+    enum                                       { K_COUN };
+
+    switch (parse_key(msg, keys))
     {
-        if      (equal(rest, "1"))                              { scpi.pulse_invert[n] = 1; update = 1; }
-        else if (equal(rest, "0"))                              { scpi.pulse_invert[n] = 0; update = 1; }
-        else                                                    { send_eps(EPA_REPLY_INVALID_ARG);      }
+        case K_COUN | QUERY: send_int(list_edges[n]);      break;
+        case K_COUN | SET:   send_eps(EPA_REPLY_READONLY); break;
+        default:             send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (equal(msg, "VAL", "id", "?"))                      { send_hex(scpi_pulse_valid[n]);        }
-    else if (start(msg, "VAL", "id", " ", rest))                { send_eps(EPA_REPLY_READONLY);         }
-    else                                                        { send_eps(EPA_REPLY_INVALID_CMD);      }
+}
 
-    if (update)
+bool list_locked(const int n)  // edge list is played by committed settings, i.e. replacing it would bypass a commit (slots are recomputed instead)
+{
+    return !scpi_conf_auto && bank_live.active[n] && bank_live.mode[n] == MODE_LIST;
+}
+
+bool recv_list(const int n)  // block of little-endian uint32 tick timestamps, invalid lists are cleared
+{
+    if (list_locked(n)) { return 0; }  // list kept, the block is discarded by skip_block()
+
+    noInterrupts();
+    scpi_trig_ready = 0;  // lists of other channels move below, update_trig_ready() requeues them
+    interrupts();
+
+    const byte start = list_base[n];
+    const byte rest  = list_base[NCHAN - 1] + list_len[NCHAN - 1] - (start + list_len[n]);  // words of the channels after n
+    const byte end   = LISTLEN - rest;
+    list_move(end, start + list_len[n], rest);  // to the top, so channel n may take all free words
+
+    const long len = recv_block();
+    bool ok = (len >= 0) && (len % 8 == 0);  // whole pulses only, so the channel always ends inactive
+    unsigned long t_prev = 0;
+    byte pos = start;
+
+    for (long i = 0; i < len; i += 4)
     {
-        bool ok = update_pulse(n);
-        update_trig_ready();
+        unsigned long t = 0;
+        int b = 0;
+        for (int j = 0; j < 32 && b != -1; j += 8)
+        {
+            b = read_byte_wait();
+            t |= (unsigned long)b << j;
+        }
+        if (b == -1) { ok = 0; break; }  // timed out
+        if (!ok)     { continue;      }  // drain the rest of the block
+
+        const unsigned long d = t - t_prev;
+        if ((i > 0 && t <= t_prev) || d > 0x7FFFFFFF) { ok = 0;                                                                     }
+        else if (d <= 0x7FFF && pos < end)             { list_data[pos++] = d;                                                 }
+        else if (pos < end - 1)                        { list_data[pos++] = 0x8000 | (d >> 16); list_data[pos++] = d & 0xFFFF; }
+        else                                           { ok = 0;                                                               }  // pool full
+        t_prev = t;
+    }
 
-        if (ok) { send_str("OK");            }
-        else    { send_eps(EPA_REPLY_CHECK); }
+    list_len[n]   = ok ? pos - start : 0;
+    list_edges[n] = ok ? len / 4     : 0;
+    list_move(start + list_len[n], end, rest);
+    list_index();
+
+    update_slots();  // slots storing channel n in LIST mode play the new list
+    update_trig_ready();
+    return ok;
+}
+
+void send_list(const int n)
+{
+    send_block(4L * list_edges[n]);
+
+    unsigned long t = 0;
+    for (byte pos = list_base[n]; pos < list_base[n] + list_len[n]; )
+    {
+        t += list_delta(pos);
+        for (int j = 0; j < 32; j += 8) { send_byte(t >> j); }
     }
+    send_str("");
 }
 
 void parse_system(const char *msg)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"REBoot", "COMMunicate"};
+    enum                                       { K_REB,    K_COMM };
 
-    if (equal(msg, "REB", "oot"))
+    switch (parse_key(msg, keys))
     {
-        send_eps(EPA_REPLY_REBOOTING);
-        wdt_enable(WDTO_1S);
-        while(1);
+        case K_REB | BARE:
+            send_eps(EPA_REPLY_REBOOTING);
+            wdt_enable(WDTO_1S);
+            while(1);
+        case K_COMM | NODE: parse_comm(msg); break;
+        default:            send_eps(EPA_REPLY_INVALID_CMD);
+    }
+}
+
+void parse_comm(const char *msg)
+{
+    static const char keys[][KEYLEN] PROGMEM = {"LAN", "SERial"};
+    enum                                       { K_LAN, K_SER };
+
+    switch (parse_key(msg, keys))
+    {
+        case K_LAN | NODE: parse_lan(msg);  break;
+        case K_SER | NODE: parse_baud(msg); break;
+        default:           send_eps(EPA_REPLY_INVALID_CMD);
+    }
+}
+
+void parse_baud(const char *msg)
+{
+    static const char keys[][KEYLEN] PROGMEM = {"BAUD"};
+    enum                                       { K_BAUD };
+    long baud;
+
+    switch (parse_key(msg, keys))
+    {
+        case K_BAUD | QUERY:
+            EEPROM.get(EPA_SERIAL_BAUD, baud);
+            send_int(baud);
+            break;
+        case K_BAUD | SET:
+            if (parse_num(msg, baud, 300, 2000000, DEF_SERIAL_BAUD))
+            {
+                EEPROM.put(EPA_SERIAL_BAUD, baud);  // save immediately
+                send_str("OK");
+                update_baud();  // the reply still goes out at the old rate
+            }
+            else { send_eps(EPA_REPLY_INVALID_ARG); }
+            break;
+        default: send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (start(msg, "COMM", "unicate", ":LAN:", rest)) { parse_lan(rest);                 }
-    else                                                   { send_eps(EPA_REPLY_INVALID_CMD); }
 }
 
 void parse_lan(const char *msg)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"MODe", "MAC", "IP", "GATEway", "SUBnet"};
+    enum                                       { K_MOD,  K_MAC, K_IP, K_GATE,    K_SUB };
     bool update = 0;
 
     SCPI_LAN scpi_lan;
     EEPROM.get(EPA_SCPI_LAN, scpi_lan);
 
-    if (equal(msg, "MOD", "e", "?"))
+    switch (parse_key(msg, keys))
     {
-        send_lan(scpi_lan.mode, NOEOL);
+        case K_MOD | QUERY:
+            send_lan(scpi_lan.mode, NOEOL);
 #ifdef LAN
-        send_str(" (ACTUAL: ",  NOEOL);
-        send_lan(scpi_lan_mode, NOEOL);
-        send_str(")");
+            send_str(" (ACTUAL: ",  NOEOL);
+            send_lan(scpi_lan_mode, NOEOL);
+            send_str(")");
 #else
-        send_str(" (ACTUAL: NOT AVAILABLE)");
+            send_str(" (ACTUAL: NOT AVAILABLE)");
 #endif
+            break;
+        case K_MOD | SET:
+            if      (equal(msg, "OFF"))        { scpi_lan.mode = LAN_OFF;    update = 1; }
+            else if (equal(msg, "DHCP"))       { scpi_lan.mode = LAN_DHCP;   update = 1; }
+            else if (equal(msg, "STAT", "ic")) { scpi_lan.mode = LAN_STATIC; update = 1; }
+            else                               { send_eps(EPA_REPLY_INVALID_ARG);        }
+            break;
+        case K_MAC | QUERY: send_mac(scpi_lan.mac); break;
+        case K_MAC | SET:
+            if (parse_mac(msg, scpi_lan.mac))  { update = 1;                             }
+            else                               { send_eps(EPA_REPLY_INVALID_ARG);        }
+            break;
+        case K_IP   | QUERY: send_ip(scpi_lan_ip);                               break;
+        case K_IP   | SET:   send_eps(EPA_REPLY_READONLY);                       break;
+        case K_IP   | NODE:  parse_lan_ip(msg, scpi_lan.ip_static,      update); break;
+        case K_GATE | QUERY: send_ip(scpi_lan_gateway);                          break;
+        case K_GATE | SET:   send_eps(EPA_REPLY_READONLY);                       break;
+        case K_GATE | NODE:  parse_lan_ip(msg, scpi_lan.gateway_static, update); break;
+        case K_SUB  | QUERY: send_ip(scpi_lan_subnet);                           break;
+        case K_SUB  | SET:   send_eps(EPA_REPLY_READONLY);                       break;
+        case K_SUB  | NODE:  parse_lan_ip(msg, scpi_lan.subnet_static,  update); break;
+        default:             send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (start(msg, "MOD", "e", " ", rest))
-    {
-        if      (equal(rest, "OFF"))          { scpi_lan.mode = LAN_OFF;    update = 1;                                }
-        else if (equal(rest, "DHCP"))         { scpi_lan.mode = LAN_DHCP;   update = 1;                                }
-        else if (equal(rest, "STAT", "ic"))   { scpi_lan.mode = LAN_STATIC; update = 1;                                }
-        else                                  { send_eps(EPA_REPLY_INVALID_ARG);                                       }
-
-    }
-    else if (equal(msg, "MAC?"))              { send_mac(scpi_lan.mac);                                                }
-    else if (start(msg, "MAC ", rest))
-    {
-        if (parse_mac(rest, scpi_lan.mac))    { update = 1;                                                            }
-        else                                  { send_eps(EPA_REPLY_INVALID_ARG);                                       }
-    }
-    else if (start(msg, "IP",          rest)) { parse_lan_ip(rest, scpi_lan_ip,      scpi_lan.ip_static,      update); }
-    else if (start(msg, "GATE", "way", rest)) { parse_lan_ip(rest, scpi_lan_gateway, scpi_lan.gateway_static, update); }
-    else if (start(msg, "SUB", "net",  rest)) { parse_lan_ip(rest, scpi_lan_subnet,  scpi_lan.subnet_static,  update); }
-    else                                      { send_eps(EPA_REPLY_INVALID_CMD);                                       }
 
     if (update)
     {
@@ -543,17 +1428,20 @@ void parse_lan(const char *msg)
     }
 }
 
-void parse_lan_ip(const char *msg, const uint32_t addr, uint32_t &addr_static, bool &update)
+void parse_lan_ip(const char *msg, uint32_t &addr_static, bool &update)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"STATic"};
+    enum                                       { K_STAT };
 
-    if      (equal(msg, "?"))                      { send_ip(addr);                   }
-    else if (start(msg, " ", rest))                { send_eps(EPA_REPLY_READONLY);    }
-    else if (equal(msg, ":STAT", "ic", "?"))       { send_ip(addr_static);            }
-    else if (start(msg, ":STAT", "ic", " ", rest))
+    switch (parse_key(msg, keys))
     {
-        if (parse_ip(rest, addr_static))           { update = 1;                      }
-        else                                       { send_eps(EPA_REPLY_INVALID_ARG); }
+        case K_STAT | QUERY:
+            send_ip(addr_static);
+            break;
+        case K_STAT | SET:
+            if (parse_ip(msg, addr_static)) { update = 1;                      }
+            else                            { send_eps(EPA_REPLY_INVALID_ARG); }
+            break;
+        default: send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else                                           { send_eps(EPA_REPLY_INVALID_CMD); }
 }
@@ -3,6 +3,11 @@
 EthernetClient client;
 #endif
 
+#define LINE_MS 2000  // timeout between bytes of a LAN message, see recv_client()
+
+char out_buf[OUTLEN];  // reply being assembled, see send_flush()
+byte out_len;
+
 bool lan;  // set before calling communication functions!
 
 int read_byte()
@@ -15,60 +20,131 @@ int read_byte()
 #endif
 }
 
-bool recv_msg(char *msg)
+struct LINE  // input of one connection, kept across calls until a message is complete
+{
+    char msg[MSGLEN];
+    byte len;   // bytes of the current message so far, MSGLEN once it is too long
+    bool done;  // msg was passed on, start over with the next byte
+    unsigned long t;  // millis() when msg last grew
+};
+
+LINE line_serial;
+#ifdef LAN
+LINE line_lan;   // shared by all clients, see recv_client()
+byte line_sock;  // socket of the client whose message is in line_lan
+#endif
+
+bool recv_msg(LINE &line)  // 1 once line.msg holds a complete message, anything after it stays in the stream for the next call
 {
-    for (int i = 0; i < MSGLEN; i++)
+    if (line.done) { line.len = 0; line.done = 0; }
+    const byte len = line.len;
+
+    int b;
+    while ((b = read_byte()) != -1)
     {
-        int b = read_byte();
-        if (b == -1 || b == '\n' || b == '\r' || i == MSGLEN - 1)
+        if (b == '\n' || b == '\r')
         {
-            msg[i] = 0;
-            break;
+            if (line.len > 0) { break; }  // empty lines, e.g. between CR and LF, are ignored
         }
-        else { msg[i] = b; }
+        else if (line.len < MSGLEN - 1) { line.msg[line.len++] = b; }
+        else                             { line.len = MSGLEN;        }
+    }
+    if (b == -1)  // incomplete, wait for more
+    {
+        if (line.len != len) { line.t = millis(); }
+        return 0;
     }
-    while (read_byte() != -1);
 
-    return (msg[0] != 0);
+    if (line.len == MSGLEN) { line.len = 0; }  // too long, passed on empty for an invalid-command reply
+    line.msg[line.len] = 0;
+    line.done = 1;
+    return 1;
 }
 
-void send_str(const char *str, const bool eol)
+#ifdef LAN
+EthernetClient recv_client(EthernetServer &server)  // a partial message keeps the other clients waiting (in their socket buffers) until it is complete or stalls for LINE_MS
 {
-    if (!lan)
+    if (line_lan.len > 0 && !line_lan.done)
     {
-        if (eol) { Serial.println(str); }
-        else     { Serial.print(str);   }
+        EthernetClient owner(line_sock);
+        if (owner.connected() && (owner.available() > 0 || millis() - line_lan.t < LINE_MS)) { return owner; }
+        line_lan.len = 0;  // closed or stalled mid-message, dropped so the next client starts afresh (the rest of it, if it ever comes, is an invalid command)
     }
+
+    EthernetClient c = server.available();
+    if (c) { line_sock = c.getSocketNumber(); }
+    return c;
+}
+#endif
+
+// replies are assembled in out_buf and written out in one piece at their end (or when full), so a reply over LAN
+// becomes a single write to the Ethernet chip rather than one per print
+
+void send_flush()
+{
+    if (out_len == 0) { return; }
+
+    if (!lan) { Serial.write((const byte *)out_buf, out_len); }
 #ifdef LAN
-    else
+    else      { client.write((const byte *)out_buf, out_len); }
+#endif
+    out_len = 0;
+}
+
+void send_char(const char c)
+{
+    if (out_len == OUTLEN) { send_flush(); }
+    out_buf[out_len++] = c;
+}
+
+void send_end(const bool eol)
+{
+    if (eol)
     {
-        if (eol) { client.println(str); }
-        else     { client.print(str);   }
+        send_char('\r');
+        send_char('\n');
+        send_flush();
     }
-#endif
 }
 
-void send_eps(const int epa, const bool eol)
+void send_str(const char *str, const bool eol)
+{
+    for (; *str != 0; str++) { send_char(*str); }
+    send_end(eol);
+}
+
+void send_eps(const int epa, const bool eol)  // straight from EEPROM, without a copy on the stack
 {
-    char eps[ESLEN];
-    EEPROM.get(epa, eps);
-    send_str(eps, eol);
+    for (int i = 0; i < ESLEN; i++)
+    {
+        const char c = EEPROM.read(epa + i);
+        if (c == 0) { break; }
+        send_char(c);
+    }
+    send_end(eol);
 }
 
 void send_num(const long value, const bool eol, const byte base)
 {
-    if (!lan)
+    unsigned long x = value;
+    if (value < 0 && base == DEC)  // other bases show the two's complement, as Serial.print() does
     {
-        if (eol) { Serial.println(value, base); }
-        else     { Serial.print(value,   base); }
+        send_char('-');
+        x = 0 - x;
     }
-#ifdef LAN
-    else
+
+    char digits[11];  // enough for 32 bits in base 10 or 16
+    byte n = 0;
+    do
     {
-        if (eol) { client.println(value, base); }
-        else     { client.print(value,   base); }
+        const byte d = x % base;
+        digits[n++] = (d < 10) ? '0' + d : 'A' + d - 10;
+        x /= base;
     }
-#endif
+    while (x > 0);
+
+    while (n > 0) { send_char(digits[--n]); }
+    send_end(eol);
 }
 
 void send_int(const long value, const bool eol) { send_num(value, eol, DEC); }
@@ -1,6 +1,7 @@
 #include "shared.h"
 
 const unsigned long conf_commit                    = 0x1234abc;  // edit to match current commit before compile/download!
+const long          conf_serial_baud               = DEF_SERIAL_BAUD;
 const char          conf_idn               [ESLEN] = "SDI DIGITAL I/O CONTROLLER";
 const char          conf_reply_readonly    [ESLEN] = "ERROR: READ-ONLY SETTING";
 const char          conf_reply_invalid_cmd [ESLEN] = "ERROR: INVALID COMMAND OR QUERY";
@@ -21,6 +22,8 @@ void setup()
     scpi_lan_initial(scpi_lan);
     EEPROM.put(EPA_SCPI_LAN, scpi_lan);
 
+    EEPROM.put(EPA_SERIAL_BAUD, conf_serial_baud);
+
     EEPROM.put(EPA_IDN,               conf_idn);
     EEPROM.put(EPA_REPLY_READONLY,    conf_reply_readonly);
     EEPROM.put(EPA_REPLY_INVALID_CMD, conf_reply_invalid_cmd);
@@ -62,6 +65,16 @@ void loop()
     Serial.print(sizeof(scpi_lan));
     Serial.println("/...");
 
+    long baud;
+    EEPROM.get(EPA_SERIAL_BAUD, baud);
+
+    Serial.print("EPA_SERIAL_BAUD/");
+    Serial.print(EPA_SERIAL_BAUD);
+    Serial.print("/");
+    Serial.print(sizeof(baud));
+    Serial.print("/");
+    Serial.println(baud);
+
     check_eps(EPA_IDN,               "EPA_IDN");
     check_eps(EPA_REPLY_READONLY,    "EPA_REPLY_READONLY");
     check_eps(EPA_REPLY_INVALID_CMD, "EPA_REPLY_INVALID_CMD");
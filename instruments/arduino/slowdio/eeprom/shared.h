@@ -7,6 +7,8 @@
 #define LAN_DHCP   1
 #define LAN_STATIC 2
 
+#define DEF_SERIAL_BAUD 9600  // also taken for DEFault arguments
+
 // EEPROM addresses:
 #define EPA_COMMIT            0
 #define EPA_SCPI              4
@@ -18,6 +20,7 @@
 #define EPA_REPLY_REBOOT_REQ  260
 #define EPA_REPLY_REBOOTING   300
 #define EPA_REPLY_NA          340
+#define EPA_SERIAL_BAUD       380  // long
 
 struct SCPI
 {
@@ -40,6 +43,14 @@ struct SCPI_LAN
 //   - bool values must be 0 or 1
 //   - <n> in channel configs is {1, 2, 3, 4, 5, 6, 7} for outputs {A, B, C, D, E, F, G}
 //   - abbreviations are supported where noted, e.g INVert matches both INV and INVERT
+//   - messages end in LF or CR (or both) and several may be sent at once, they are answered in order, one line per command,
+//     a message may hold commands separated by ';' (e.g. :DIO1:DIRection OUT;INVert 1), where a command starting with neither ':' nor '*'
+//     continues from the node of the previous one (spaces after the ';' are ignored)
+//   - numbers may carry a sign, decimal point, and exponent (e.g. 9.6e3), or be MINimum, MAXimum, or DEFault instead,
+//     values out of range are rejected rather than clipped
+//   - :SYSTem:COMMunicate:SERial:BAUD is saved immediately and applied right after its reply (300 to 2000000),
+//     it has no effect on the data rate of boards with native USB like the Leonardo, where Serial is a USB CDC port
+//   - LAN clients are served one message at a time, a client pausing for more than 2 s within a message loses that message
 //   - LAN settings do not take effect until reboot!
 
 void scpi_default(SCPI &s)
@@ -1,54 +1,118 @@
-#define ZERO_OK  1
-#define ZERO_NOK 0
+// parsing moves a cursor (const char *&) through the message in place, nothing is copied
 
-long pow10(const long x, const int z)
+bool match(const char *&str, const char *cmp)  // on a case-insensitive match of cmp, str moves past it
 {
-    long y = 1;
-    for (int i = 0; i < abs(z); i++) { y *= 10; }
-    return (z < 0) ? x / y : x * y;
+    const char *str_p = str;
+    for (; *cmp != 0; cmp++, str_p++)
+    {
+        if (toupper(*str_p) != toupper(*cmp)) { return 0; }  // also stops at the end of str
+    }
+
+    str = str_p;
+    return 1;
 }
 
-bool parse_num(const char *str, long &value, const bool zero_ok, const int exp)
+bool equal(const char *str, const char *pre, const char *opt)  // str is pre or pre + opt, e.g. STAT or STATIC
 {
-    int len = strlen(str);
-    int dpt = -1;  // first occurance of decimal point
-    int ept = -1;  // first occurance of exponent symbol
-    for (int i = 0; i < len; i++)
+    return match(str, pre) && (*str == 0 || (match(str, opt) && *str == 0));
+}
+
+bool equal(const char *str, const char *cmp) { return equal(str, cmp, ""); }
+
+// numbers follow SCPI <NRf> (optional sign, digits with optional decimal point, optional exponent, e.g. -1.5e-3), may be
+// followed by a unit (e.g. 10 ms, 2.5 MHz), or are MINimum, MAXimum, or DEFault, the result is rounded half up to whole
+// units of 10^-exp, and is rejected on any other character, on overflow, or outside lo to hi
+#define NUM_MAX 0x7FFFFFFFL  // largest number, LONG_MAX on AVR (fixed, so hosts with a wider long parse alike)
+
+struct UNIT
+{
+    char   name[4];
+    int8_t exp;  // power of ten relative to the base unit
+};
+
+const UNIT units_sec[] PROGMEM = {{"S", 0}, {"MS", -3}, {"US", -6}, {"NS", -9}};
+
+bool parse_num(const char *str, long &value, const long lo, const long hi, const long *def, int exp, const UNIT *units, const byte count)
+{
+    if (isalpha(*str))
     {
-        if (dpt == -1 && str[i] == '.')                    { dpt = i; }
-        if (ept == -1 && (str[i] == 'e' || str[i] == 'E')) { ept = i; }
+        if      (equal(str, "MIN", "IMUM"))        { value = lo;   return 1; }
+        else if (equal(str, "MAX", "IMUM"))        { value = hi;   return 1; }
+        else if (equal(str, "DEF", "AULT") && def) { value = *def; return 1; }
+        else                                       { return 0;               }
     }
 
-    long a = atol(str);
-    if (a < 0 || (a == 0 && str[0] != '0' && str[0] != '.')) { return 0; }  // a == 0 could come from a conversion error
+    const bool neg = (*str == '-');
+    if (*str == '-' || *str == '+') { str++; }
+
+    uint32_t mant   = 0;  // significant digits, as many as fit
+    byte     next   = 0;  // first digit that did not fit, later ones cannot change the rounding
+    bool     full   = 0;
+    bool     point  = 0;
+    bool     digits = 0;
+    for (; isdigit(*str) || (*str == '.' && !point); str++)
+    {
+        if (*str == '.') { point = 1; continue; }
+
+        const byte d = *str - '0';
+        digits = 1;
+        if (!full && mant <= (NUM_MAX - d) / 10) { mant = 10*mant + d; if (point) { exp--; } }
+        else                                      { if (!full) { next = d; full = 1; } if (!point) { exp++; } }
+    }
+    if (!digits) { return 0; }
 
-    long b = 0;
-    if (dpt != -1)
+    if (*str == 'e' || *str == 'E')
     {
-        const char *str_p = str + dpt + 1;
-        b = atol(str_p);
-        if (b < 0 || (b == 0 && str_p[0] != '0')) { return 0; }  // b == 0 could come from a conversion error
+        str++;
+        const bool exp_neg = (*str == '-');
+        if (*str == '-' || *str == '+') { str++; }
+        if (!isdigit(*str)) { return 0; }
+
+        int e = 0;
+        for (; isdigit(*str); str++) { if (e < 1000) { e = 10*e + (*str - '0'); } }  // anything beyond over- or underflows anyway
+        exp += exp_neg ? -e : e;
     }
 
-    int c = 0;
-    if (ept != -1)
+    while (*str == ' ') { str++; }
+    if (*str != 0)
     {
-        const char *str_p = str + ept + 1;
-        c = atoi(str_p);
-        if (c == 0 && str_p[0] != '0') { return 0; }  // c == 0 could come from a conversion error
+        byte u = 0;
+        while (u < count && strcasecmp_P(str, units[u].name) != 0) { u++; }
+        if (u == count) { return 0; }
+        exp += (int8_t)pgm_read_byte(&units[u].exp);
     }
 
-    if (a > 0 || b > 0 || zero_ok)  // non-negativity already checked above
+    if (exp > 0)
     {
-        int dig = (dpt == -1) ? 0 : ((ept == -1) ? len - dpt - 1 : ept - dpt - 1);
-        value = pow10(a, c + exp) + pow10(b, c + exp - dig);  // always greater than (or equal to zero, if zero_ok is set)
-        return 1;
+        if (full) { return 0; }  // the digit that did not fit would end up in front of the decimal point
+        for (; exp > 0 && mant > 0; exp--)
+        {
+            if (mant > NUM_MAX / 10) { return 0; }
+            mant *= 10;
+        }
     }
-    else { return 0; }
+    else if (exp == 0)
+    {
+        if (next >= 5) { if (mant == NUM_MAX) { return 0; } mant++; }
+    }
+    else if (exp < -9) { mant = 0; }  // below 0.5 for any 31-bit mant
+    else
+    {
+        uint32_t div = 1;
+        for (; exp < 0; exp++) { div *= 10; }
+        mant = mant / div + (2*(mant % div) >= div);  // the digits that did not fit lie below the remainder
+    }
+
+    const long v = neg ? -(long)mant : (long)mant;
+    if (v < lo || v > hi) { return 0; }
+
+    value = v;
+    return 1;
 }
 
-bool parse_num(const char *str, long &value, bool zero_ok)    { return parse_num(str, value, zero_ok, 0); }
-bool parse_micros(const char *str, long &value, bool zero_ok) { return parse_num(str, value, zero_ok, 6); }
+bool parse_num(const char *str, long &value, const long lo, const long hi)                    { return parse_num(str, value, lo, hi, NULL, 0, NULL, 0); }
+bool parse_num(const char *str, long &value, const long lo, const long hi, const long def)    { return parse_num(str, value, lo, hi, &def, 0, NULL, 0); }
+bool parse_micros(const char *str, long &value, const long lo, const long hi, const long def) { return parse_num(str, value, lo, hi, &def, 6, units_sec, sizeof(units_sec) / sizeof(UNIT)); }
 
 bool split(const char *str, const char sep, int *offset, const int len)
 {
@@ -124,35 +188,95 @@ bool parse_ip(const char *str, uint32_t &value)
     return 1;
 }
 
-bool start_match(const char *str_p, char *rest)
+// keyword tables, e.g. {"DELay", "WIDth", "PULSe#"}, are stored in flash: uppercase letters give the short form, the whole
+// word the long form, a trailing '#' allows a numeric suffix (as in :PULSe1:), and keywords of the first level include ':'
+#define KEYLEN 12  // longest keyword (COMMunicate) plus null-terminator
+
+// parse_key() returns the index of the matching keyword combined with what follows it:
+#define BARE   0x00  // end of message, e.g. *RST
+#define QUERY  0x20  // '?' and end of message, QUERY | SET for '?' followed by arguments
+#define SET    0x40  // ' ' and arguments
+#define NODE   0x80  // ':' and the next level
+#define FORM   0xE0  // mask of the above
+#define NO_KEY 0xFF  // no match or invalid separator
+
+byte parse_key(const char *&str, const char (*keys)[KEYLEN], const byte count, int &suffix)  // on match, str moves past the separator
 {
-    if (rest != NULL)
-    {
-        if (strlen(str_p) > 0) { strcpy(rest, str_p); }
-        else                   { rest[0] = 0;         }
+    const char *str_p = str;
+    if (*str_p == ':' || *str_p == '*') { str_p++; }
+    while (isalpha(*str_p))             { str_p++; }
+    const byte len = str_p - str;
 
-        return 1;  // start matches and remainder is allowed
+    int num = -1;  // no suffix
+    for (; isdigit(*str_p); str_p++)
+    {
+        num = (num < 0) ? *str_p - '0' : 10*num + (*str_p - '0');
+        if (num > 999) { return NO_KEY; }
     }
-    else { return (str_p[0] == 0); }  // exact match required
-}
 
-bool start(const char *str, const char *pre, const char *opt, const char *suf, char *rest)
-{
-    int pre_len = strlen(pre);
-    int opt_len = strlen(opt);
-    int suf_len = strlen(suf);
+    byte form;
+    if      (str_p[0] == 0)                      { form = BARE;                    }
+    else if (str_p[0] == '?' && str_p[1] == 0)   { form = QUERY;       str_p += 1; }
+    else if (str_p[0] == '?' && str_p[1] == ' ') { form = QUERY | SET; str_p += 2; }
+    else if (str_p[0] == ' ')                    { form = SET;         str_p += 1; }
+    else if (str_p[0] == ':')                    { form = NODE;        str_p += 1; }
+    else                                         { return NO_KEY;                  }
 
-    if (strncasecmp(str, pre, pre_len) == 0)
+    for (byte k = 0; k < count; k++)
     {
-        if      (strncasecmp(str + pre_len, opt, opt_len) == 0 && strncasecmp(str + pre_len + opt_len, suf, suf_len) == 0) { return start_match(str + pre_len + opt_len + suf_len, rest); }
-        else if (strncasecmp(str + pre_len, suf, suf_len) == 0)                                                            { return start_match(str + pre_len + suf_len,           rest); }
+        if (toupper(pgm_read_byte(keys[k])) != toupper(*str)) { continue; }  // most keywords differ in the first letter
+
+        byte key_len = strlen_P(keys[k]);
+        const bool key_num = (key_len > 0 && pgm_read_byte(keys[k] + key_len - 1) == '#');
+        if (key_num) { key_len--; }
+
+        byte key_short = 0;
+        while (key_short < key_len && !islower(pgm_read_byte(keys[k] + key_short))) { key_short++; }
+
+        if ((len == key_short || len == key_len) && (num < 0 || key_num) && strncasecmp_P(str, keys[k], len) == 0)
+        {
+            str    = str_p;
+            suffix = num;
+            return k | form;
+        }
     }
 
-    return 0;
+    return NO_KEY;
 }
 
-bool start(const char *str, const char *cmp, char *rest)                       { return start(str, cmp, "",  "",  rest); }
-bool start(const char *str, const char *pre, const char *opt, char *rest)      { return start(str, pre, opt, "",  rest); }
-bool equal(const char *str, const char *cmp)                                   { return start(str, cmp, "",  "",  NULL); }
-bool equal(const char *str, const char *pre, const char *opt)                  { return start(str, pre, opt, "",  NULL); }
-bool equal(const char *str, const char *pre, const char *opt, const char *suf) { return start(str, pre, opt, suf, NULL); }
+template <int N> byte parse_key(const char *&str, const char (&keys)[N][KEYLEN], int &suffix) {             return parse_key(str, keys, N, suffix); }
+template <int N> byte parse_key(const char *&str, const char (&keys)[N][KEYLEN])              { int suffix; return parse_key(str, keys, N, suffix); }
+
+// a message may hold several commands separated by ';', e.g. :DIO1:DIRection OUT;INVert 1, where a command starting with
+// neither ':' nor '*' continues from the node of the previous one (here :DIO1:), each command replies on its own line
+void parse_compound(char *msg, void (*parse)(const char *))  // splits msg in place, msg must be writable
+{
+    char *node     = msg;  // node path of the previous command, e.g. :DIO1: of :DIO1:DIRection OUT, is node[0] to node[node_len - 1]
+    byte  node_len = 0;
+    for (char *part = msg; ; )
+    {
+        while (*part == ' ') { part++; }  // e.g. after "; "
+        char *end = part;
+        while (*end != 0 && *end != ';') { end++; }
+        const bool last = (*end == 0);
+        *end = 0;
+
+        char *cmd = part;
+        if (*part != ':' && *part != '*' && node_len > 0)  // node path goes right in front, over the previous command, which always has room
+        {
+            cmd = part - node_len;
+            memmove(cmd, node, node_len);
+        }
+        parse(cmd);
+
+        if (*part != '*')  // common commands keep the node
+        {
+            node     = cmd;
+            node_len = 0;
+            for (byte j = 0; cmd[j] != 0 && cmd[j] != ' ' && cmd[j] != '?'; j++) { if (cmd[j] == ':') { node_len = j + 1; } }
+        }
+
+        if (last) { return; }
+        part = end + 1;
+    }
+}
@@ -1,5 +1,6 @@
 #define LAN
 #define MSGLEN 64  // includes null-terminator
+#define OUTLEN 64  // reply output buffer, written out at end of line or when full
 #define PORT   18
 
 #include <avr/wdt.h>
@@ -45,7 +46,7 @@ void setup()
 
     for (int n = 0; n < NCHAN; n++) { update_dio(n); }
 
-    Serial.begin(9600);
+    update_baud();
 
 #ifdef LAN
     SCPI_LAN scpi_lan;
@@ -74,19 +75,17 @@ void loop()
     if (Serial.available() > 0)
     {
         lan = 0;  // receive/send via Serial
-        char msg[MSGLEN];
-        if (recv_msg(msg)) { parse_msg(msg); }
+        if (recv_msg(line_serial)) { parse_compound(line_serial.msg, parse_msg); send_flush(); }  // one message per loop
     }
 
 #ifdef LAN
     if (scpi_lan_mode != LAN_OFF)
     {
-        client = server.available();
+        client = recv_client(server);
         if (client)
         {
             lan = 1;  // receive/send via client
-            char msg[MSGLEN];
-            if (recv_msg(msg)) { parse_msg(msg); }
+            if (recv_msg(line_lan)) { parse_compound(line_lan.msg, parse_msg); send_flush(); }
         }
     }
 
@@ -129,6 +128,17 @@ void update_dio(const int n)
     else { pinMode(conf_dio_pin[n], scpi.dio_pullup[n] ? INPUT_PULLUP : INPUT); }
 }
 
+void update_baud()
+{
+    long baud;
+    EEPROM.get(EPA_SERIAL_BAUD, baud);
+    if (baud < 300 || baud > 2000000) { baud = 9600; }  // e.g. EEPROM not yet initialized
+
+    Serial.flush();  // pending output at the old rate
+    Serial.end();
+    Serial.begin(baud);
+}
+
 void update_lan()
 {
 #ifdef LAN
@@ -149,33 +159,36 @@ void update_lan()
 
 void parse_msg(const char *msg)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"*IDN", "*SAV", "*RCL", "*RST", ":DIO#", ":SYSTem"};
+    enum                                       { K_IDN,  K_SAV,  K_RCL,  K_RST,  K_DIO,   K_SYST };
     bool update = 0;
+    int n;
 
-    if (equal(msg, "*IDN?"))
+    switch (parse_key(msg, keys, n))
     {
-        unsigned long eeprom_commit;
-        EEPROM.get(EPA_COMMIT, eeprom_commit);
-
-        send_eps(EPA_IDN,       NOEOL);
-        send_str(" (PROG: ",    NOEOL);
-        send_hex(conf_commit,   NOEOL);
-        send_str(", EEPROM: ",  NOEOL);
-        send_hex(eeprom_commit, NOEOL);
-        send_str(")");
+        case K_IDN | QUERY:
+        {
+            unsigned long eeprom_commit;
+            EEPROM.get(EPA_COMMIT, eeprom_commit);
+
+            send_eps(EPA_IDN,       NOEOL);
+            send_str(" (PROG: ",    NOEOL);
+            send_hex(conf_commit,   NOEOL);
+            send_str(", EEPROM: ",  NOEOL);
+            send_hex(eeprom_commit, NOEOL);
+            send_str(")");
+            break;
+        }
+        case K_SAV | BARE: EEPROM.put(EPA_SCPI, scpi); send_str("OK"); break;
+        case K_RCL | BARE: EEPROM.get(EPA_SCPI, scpi); update = 1;     break;
+        case K_RST | BARE: scpi_default(scpi); update = 1;             break;
+        case K_DIO | NODE:
+            if (n >= 1 && n <= NCHAN) { parse_dio(n - 1, msg);            }
+            else                      { send_eps(EPA_REPLY_INVALID_CMD); }
+            break;
+        case K_SYST | NODE: parse_system(msg); break;
+        default:            send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (equal(msg, "*SAV"))                   { EEPROM.put(EPA_SCPI, scpi); send_str("OK"); }
-    else if (equal(msg, "*RCL"))                   { EEPROM.get(EPA_SCPI, scpi); update = 1;     }
-    else if (equal(msg, "*RST"))                   { scpi_default(scpi);         update = 1;     }
-    else if (start(msg, ":DIO1:", rest))           { parse_dio(0, rest);                         }
-    else if (start(msg, ":DIO2:", rest))           { parse_dio(1, rest);                         }
-    else if (start(msg, ":DIO3:", rest))           { parse_dio(2, rest);                         }
-    else if (start(msg, ":DIO4:", rest))           { parse_dio(3, rest);                         }
-    else if (start(msg, ":DIO5:", rest))           { parse_dio(4, rest);                         }
-    else if (start(msg, ":DIO6:", rest))           { parse_dio(5, rest);                         }
-    else if (start(msg, ":DIO7:", rest))           { parse_dio(6, rest);                         }
-    else if (start(msg, ":SYST", "em", ":", rest)) { parse_system(rest);                         }
-    else                                           { send_eps(EPA_REPLY_INVALID_CMD);            }
 
     if (update)
     {
@@ -186,37 +199,38 @@ void parse_msg(const char *msg)
 
 void parse_dio(const int n, const char *msg)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"DIRection", "INVert", "INput", "OUTput", "VALue"};
+    enum                                       { K_DIR,       K_INV,    K_IN,    K_OUT,    K_VAL };
     bool update = 0;
 
-    if      (equal(msg, "DIR", "ection", "?"))       { send_str(scpi.dio_dir[n] == INPUT ? "INPUT" : "OUTPUT"); }
-    else if (start(msg, "DIR", "ection", " ", rest))
-    {
-        if      (equal(rest, "IN", "put"))           { scpi.dio_dir[n] = INPUT;  update = 1;                    }
-        else if (equal(rest, "OUT", "put"))          { scpi.dio_dir[n] = OUTPUT; update = 1;                    }
-        else                                         { send_eps(EPA_REPLY_INVALID_ARG);                         }
-    }
-    else if (equal(msg, "INV", "ert", "?"))          { send_hex(scpi.dio_invert[n]);                            }
-    else if (start(msg, "INV", "ert", " ",    rest))
+    switch (parse_key(msg, keys))
     {
-        if      (equal(rest, "1"))                   { scpi.dio_invert[n] = 1;   update = 1;                    }
-        else if (equal(rest, "0"))                   { scpi.dio_invert[n] = 0;   update = 1;                    }
-        else                                         { send_eps(EPA_REPLY_INVALID_ARG);                         }
+        case K_DIR | QUERY: send_str(scpi.dio_dir[n] == INPUT ? "INPUT" : "OUTPUT"); break;
+        case K_DIR | SET:
+            if      (equal(msg, "IN", "put"))  { scpi.dio_dir[n] = INPUT;  update = 1; }
+            else if (equal(msg, "OUT", "put")) { scpi.dio_dir[n] = OUTPUT; update = 1; }
+            else                               { send_eps(EPA_REPLY_INVALID_ARG);      }
+            break;
+        case K_INV | QUERY: send_hex(scpi.dio_invert[n]); break;
+        case K_INV | SET:
+            if      (equal(msg, "1"))          { scpi.dio_invert[n] = 1;   update = 1; }
+            else if (equal(msg, "0"))          { scpi.dio_invert[n] = 0;   update = 1; }
+            else                               { send_eps(EPA_REPLY_INVALID_ARG);      }
+            break;
+        case K_IN  | NODE:  parse_input(n, msg);     break;
+        case K_OUT | NODE:  parse_output(n, msg);    break;
+        case K_VAL | QUERY: send_hex(read_input(n)); break;  // also works for output pins (TODO: confirm this)
+        case K_VAL | SET:
+            if (scpi.dio_dir[n] == OUTPUT)
+            {
+                if      (equal(msg, "1"))      { scpi.dio_setval[n] = 1;   update = 1; }
+                else if (equal(msg, "0"))      { scpi.dio_setval[n] = 0;   update = 1; }
+                else                           { send_eps(EPA_REPLY_INVALID_ARG);      }
+            }
+            else                               { send_eps(EPA_REPLY_READONLY);         }
+            break;
+        default: send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (start(msg, "IN", "put",  ":",    rest)) { parse_input(n, rest);                                    }
-    else if (start(msg, "OUT", "put", ":",    rest)) { parse_output(n, rest);                                   }
-    else if (equal(msg, "VAL", "ue", "?"))           { send_hex(read_input(n));                                 }  // also works for output pins (TODO: confirm this)
-    else if (start(msg, "VAL", "ue", " ",     rest))
-    {
-        if (scpi.dio_dir[n] == OUTPUT) 
-        {
-            if      (equal(rest, "1"))               { scpi.dio_setval[n] = 1;   update = 1;                    }
-            else if (equal(rest, "0"))               { scpi.dio_setval[n] = 0;   update = 1;                    }
-            else                                     { send_eps(EPA_REPLY_INVALID_ARG);                         }
-        }
-        else                                         { send_eps(EPA_REPLY_READONLY);                            }
-    }
-    else                                             { send_eps(EPA_REPLY_INVALID_CMD);                         }
 
     if (update)
     {
@@ -227,23 +241,25 @@ void parse_dio(const int n, const char *msg)
 
 void parse_input(const int n, const char *msg)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"PULLup", "VALue"};
+    enum                                       { K_PULL,   K_VAL };
     bool update = 0;
 
-    if      (equal(msg, "PULL", "up", "?"))       { send_hex(scpi.dio_pullup[n]);       }
-    else if (start(msg, "PULL", "up", " ", rest))
+    switch (parse_key(msg, keys))
     {
-        if      (equal(rest, "1"))                { scpi.dio_pullup[n] = 1; update = 1; }
-        else if (equal(rest, "0"))                { scpi.dio_pullup[n] = 0; update = 1; }
-        else                                      { send_eps(EPA_REPLY_INVALID_ARG);    }
+        case K_PULL | QUERY: send_hex(scpi.dio_pullup[n]); break;
+        case K_PULL | SET:
+            if      (equal(msg, "1"))          { scpi.dio_pullup[n] = 1; update = 1; }
+            else if (equal(msg, "0"))          { scpi.dio_pullup[n] = 0; update = 1; }
+            else                               { send_eps(EPA_REPLY_INVALID_ARG);    }
+            break;
+        case K_VAL | QUERY:
+            if (scpi.dio_dir[n] == INPUT)      { send_hex(read_input(n));            }
+            else                               { send_eps(EPA_REPLY_NA);             }
+            break;
+        case K_VAL | SET: send_eps(EPA_REPLY_READONLY); break;
+        default:          send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (equal(msg, "VAL", "ue", "?"))
-    {
-        if (scpi.dio_dir[n] == INPUT)             { send_hex(read_input(n));            }
-        else                                      { send_eps(EPA_REPLY_NA);             }
-    }
-    else if (start(msg, "VAL", "ue", " ",  rest)) { send_eps(EPA_REPLY_READONLY);       }
-    else                                          { send_eps(EPA_REPLY_INVALID_CMD);    }
 
     if (update)
     {
@@ -254,17 +270,20 @@ void parse_input(const int n, const char *msg)
 
 void parse_output(const int n, const char *msg)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"VALue"};
+    enum                                       { K_VAL };
     bool update = 0;
 
-    if      (equal(msg, "VAL", "ue", "?"))       { send_hex(scpi.dio_setval[n]);       }
-    else if (start(msg, "VAL", "ue", " ", rest))
+    switch (parse_key(msg, keys))
     {
-        if      (equal(rest, "1"))               { scpi.dio_setval[n] = 1; update = 1; }
-        else if (equal(rest, "0"))               { scpi.dio_setval[n] = 0; update = 1; }
-        else                                     { send_eps(EPA_REPLY_INVALID_ARG);    }
+        case K_VAL | QUERY: send_hex(scpi.dio_setval[n]); break;
+        case K_VAL | SET:
+            if      (equal(msg, "1"))          { scpi.dio_setval[n] = 1; update = 1; }
+            else if (equal(msg, "0"))          { scpi.dio_setval[n] = 0; update = 1; }
+            else                               { send_eps(EPA_REPLY_INVALID_ARG);    }
+            break;
+        default: send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else                                         { send_eps(EPA_REPLY_INVALID_CMD);    }
 
     if (update)
     {
@@ -275,55 +294,101 @@ void parse_output(const int n, const char *msg)
 
 void parse_system(const char *msg)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"REBoot", "COMMunicate"};
+    enum                                       { K_REB,    K_COMM };
 
-    if (equal(msg, "REB", "oot"))
+    switch (parse_key(msg, keys))
     {
-        send_eps(EPA_REPLY_REBOOTING);
-        wdt_enable(WDTO_1S);
-        while(1);
+        case K_REB | BARE:
+            send_eps(EPA_REPLY_REBOOTING);
+            wdt_enable(WDTO_1S);
+            while(1);
+        case K_COMM | NODE: parse_comm(msg); break;
+        default:            send_eps(EPA_REPLY_INVALID_CMD);
+    }
+}
+
+void parse_comm(const char *msg)
+{
+    static const char keys[][KEYLEN] PROGMEM = {"LAN", "SERial"};
+    enum                                       { K_LAN, K_SER };
+
+    switch (parse_key(msg, keys))
+    {
+        case K_LAN | NODE: parse_lan(msg);  break;
+        case K_SER | NODE: parse_baud(msg); break;
+        default:           send_eps(EPA_REPLY_INVALID_CMD);
+    }
+}
+
+void parse_baud(const char *msg)
+{
+    static const char keys[][KEYLEN] PROGMEM = {"BAUD"};
+    enum                                       { K_BAUD };
+    long baud;
+
+    switch (parse_key(msg, keys))
+    {
+        case K_BAUD | QUERY:
+            EEPROM.get(EPA_SERIAL_BAUD, baud);
+            send_int(baud);
+            break;
+        case K_BAUD | SET:
+            if (parse_num(msg, baud, 300, 2000000, DEF_SERIAL_BAUD))
+            {
+                EEPROM.put(EPA_SERIAL_BAUD, baud);  // save immediately
+                send_str("OK");
+                update_baud();  // the reply still goes out at the old rate
+            }
+            else { send_eps(EPA_REPLY_INVALID_ARG); }
+            break;
+        default: send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (start(msg, "COMM", "unicate", ":LAN:", rest)) { parse_lan(rest);                 }
-    else                                                   { send_eps(EPA_REPLY_INVALID_CMD); }
 }
 
 void parse_lan(const char *msg)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"MODe", "MAC", "IP", "GATEway", "SUBnet"};
+    enum                                       { K_MOD,  K_MAC, K_IP, K_GATE,    K_SUB };
     bool update = 0;
 
     SCPI_LAN scpi_lan;
     EEPROM.get(EPA_SCPI_LAN, scpi_lan);
 
-    if (equal(msg, "MOD", "e", "?"))
+    switch (parse_key(msg, keys))
     {
-        send_lan(scpi_lan.mode, NOEOL);
+        case K_MOD | QUERY:
+            send_lan(scpi_lan.mode, NOEOL);
 #ifdef LAN
-        send_str(" (ACTUAL: ",  NOEOL);
-        send_lan(scpi_lan_mode, NOEOL);
-        send_str(")");
+            send_str(" (ACTUAL: ",  NOEOL);
+            send_lan(scpi_lan_mode, NOEOL);
+            send_str(")");
 #else
-        send_str(" (ACTUAL: NOT AVAILABLE)");
+            send_str(" (ACTUAL: NOT AVAILABLE)");
 #endif
+            break;
+        case K_MOD | SET:
+            if      (equal(msg, "OFF"))        { scpi_lan.mode = LAN_OFF;    update = 1; }
+            else if (equal(msg, "DHCP"))       { scpi_lan.mode = LAN_DHCP;   update = 1; }
+            else if (equal(msg, "STAT", "ic")) { scpi_lan.mode = LAN_STATIC; update = 1; }
+            else                               { send_eps(EPA_REPLY_INVALID_ARG);        }
+            break;
+        case K_MAC | QUERY: send_mac(scpi_lan.mac); break;
+        case K_MAC | SET:
+            if (parse_mac(msg, scpi_lan.mac))  { update = 1;                             }
+            else                               { send_eps(EPA_REPLY_INVALID_ARG);        }
+            break;
+        case K_IP   | QUERY: send_ip(scpi_lan_ip);                               break;
+        case K_IP   | SET:   send_eps(EPA_REPLY_READONLY);                       break;
+        case K_IP   | NODE:  parse_lan_ip(msg, scpi_lan.ip_static,      update); break;
+        case K_GATE | QUERY: send_ip(scpi_lan_gateway);                          break;
+        case K_GATE | SET:   send_eps(EPA_REPLY_READONLY);                       break;
+        case K_GATE | NODE:  parse_lan_ip(msg, scpi_lan.gateway_static, update); break;
+        case K_SUB  | QUERY: send_ip(scpi_lan_subnet);                           break;
+        case K_SUB  | SET:   send_eps(EPA_REPLY_READONLY);                       break;
+        case K_SUB  | NODE:  parse_lan_ip(msg, scpi_lan.subnet_static,  update); break;
+        default:             send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else if (start(msg, "MOD", "e", " ", rest))
-    {
-        if      (equal(rest, "OFF"))          { scpi_lan.mode = LAN_OFF;    update = 1;                                }
-        else if (equal(rest, "DHCP"))         { scpi_lan.mode = LAN_DHCP;   update = 1;                                }
-        else if (equal(rest, "STAT", "ic"))   { scpi_lan.mode = LAN_STATIC; update = 1;                                }
-        else                                  { send_eps(EPA_REPLY_INVALID_ARG);                                       }
-
-    }
-    else if (equal(msg, "MAC?"))              { send_mac(scpi_lan.mac);                                                }
-    else if (start(msg, "MAC ", rest))
-    {
-        if (parse_mac(rest, scpi_lan.mac))    { update = 1;                                                            }
-        else                                  { send_eps(EPA_REPLY_INVALID_ARG);                                       }
-    }
-    else if (start(msg, "IP",          rest)) { parse_lan_ip(rest, scpi_lan_ip,      scpi_lan.ip_static,      update); }
-    else if (start(msg, "GATE", "way", rest)) { parse_lan_ip(rest, scpi_lan_gateway, scpi_lan.gateway_static, update); }
-    else if (start(msg, "SUB", "net",  rest)) { parse_lan_ip(rest, scpi_lan_subnet,  scpi_lan.subnet_static,  update); }
-    else                                      { send_eps(EPA_REPLY_INVALID_CMD);                                       }
 
     if (update)
     {
@@ -332,17 +397,20 @@ void parse_lan(const char *msg)
     }
 }
 
-void parse_lan_ip(const char *msg, const uint32_t addr, uint32_t &addr_static, bool &update)
+void parse_lan_ip(const char *msg, uint32_t &addr_static, bool &update)
 {
-    char rest[MSGLEN];
+    static const char keys[][KEYLEN] PROGMEM = {"STATic"};
+    enum                                       { K_STAT };
 
-    if      (equal(msg, "?"))                      { send_ip(addr);                   }
-    else if (start(msg, " ", rest))                { send_eps(EPA_REPLY_READONLY);    }
-    else if (equal(msg, ":STAT", "ic", "?"))       { send_ip(addr_static);            }
-    else if (start(msg, ":STAT", "ic", " ", rest))
+    switch (parse_key(msg, keys))
     {
-        if (parse_ip(rest, addr_static))           { update = 1;                      }
-        else                                       { send_eps(EPA_REPLY_INVALID_ARG); }
+        case K_STAT | QUERY:
+            send_ip(addr_static);
+            break;
+        case K_STAT | SET:
+            if (parse_ip(msg, addr_static)) { update = 1;                      }
+            else                            { send_eps(EPA_REPLY_INVALID_ARG); }
+            break;
+        default: send_eps(EPA_REPLY_INVALID_CMD);
     }
-    else                                           { send_eps(EPA_REPLY_INVALID_CMD); }
 }
@@ -0,0 +1,194 @@
+// description: host stand-ins for the parts of the Arduino core (ATmega32u4) used by the instrument sketches
+
+// notes:
+//   - only what the sketches and testing/host drivers need, see host.cpp for the definitions
+//   - plain registers are variables, TCNT1 and TIFR1 behave like the hardware (reads of TCNT1 go through
+//     host_tcnt1_read(), writing a 1 to a TIFR1 bit clears it), so drivers can model Timer1
+//   - interrupts are never taken on their own, drivers call the ISRs (e.g. TIMER1_COMPA_vect()) themselves
+
+#pragma once
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+typedef uint8_t      byte;
+typedef bool         boolean;
+typedef unsigned int word;
+
+#define HIGH 1
+#define LOW  0
+
+#define INPUT        0
+#define OUTPUT       1
+#define INPUT_PULLUP 2
+
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define INTERNAL 3
+#define EXTERNAL 0
+
+#define DEC 10
+#define HEX 16
+
+#define NOT_AN_INTERRUPT -1
+#define NOT_A_PORT       0
+
+#define PROGMEM
+#define PSTR(s)             (s)
+#define F(s)                (s)
+#define pgm_read_byte(p)    (*(const uint8_t *)(p))
+#define pgm_read_word(p)    (*(const uint16_t *)(p))
+#define pgm_read_dword(p)   (*(const uint32_t *)(p))
+#define pgm_read_ptr(p)     (*(void * const *)(p))
+#define memcpy_P            memcpy
+#define strlen_P            strlen
+#define strcasecmp_P        strcasecmp
+#define strncasecmp_P       strncasecmp
+
+#define bit(b)    (1UL << (b))
+#define _BV(b)    (1 << (b))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+#define ISR(v)               extern "C" void v()
+#define ATOMIC_BLOCK(x)      for (int _atomic = 1; _atomic; _atomic = 0)
+#define ATOMIC_RESTORESTATE  0
+#define cli()                do {} while (0)
+#define sei()                do {} while (0)
+#define noInterrupts()       do {} while (0)
+#define interrupts()         do {} while (0)
+
+// registers:
+
+struct Tifr  // interrupt flags, cleared by writing 1
+{
+    uint8_t v;
+    Tifr &operator=(const uint8_t b) { v &= ~b; return *this; }
+    operator uint8_t() const { return v; }
+};
+
+struct Tcnt  // counter, see host_tcnt1_read()
+{
+    operator uint16_t() const;
+    Tcnt &operator=(uint16_t c);
+};
+
+extern volatile uint8_t PORTB, PORTC, PORTD, PORTE, PORTF;
+extern volatile uint8_t PINB,  PINC,  PIND,  PINE,  PINF;
+extern volatile uint8_t DDRB,  DDRC,  DDRD,  DDRE,  DDRF;
+
+extern volatile uint8_t  TCCR1A, TCCR1B, TCCR1C, TIMSK1;
+extern Tifr              TIFR1;
+extern Tcnt              TCNT1;
+extern volatile uint16_t OCR1A, OCR1B, OCR1C, ICR1;
+
+extern volatile uint8_t  TCCR3A, TCCR3B, TCCR3C, TIMSK3, TIFR3;
+extern volatile uint16_t TCNT3, OCR3A, OCR3B;
+
+extern volatile uint8_t EIFR, EIMSK, EICRA, EICRB, PCICR, PCMSK0, PCIFR, SREG;
+
+#define TOV1   0
+#define OCF1A  1
+#define OCF1B  2
+#define OCF1C  3
+#define TOIE1  0
+#define OCIE1A 1
+#define OCIE1B 2
+#define OCIE1C 3
+#define FOC1A  7
+#define FOC1B  6
+#define FOC1C  5
+#define COM1A0 6
+#define COM1A1 7
+#define COM1B0 4
+#define COM1B1 5
+#define COM1C0 2
+#define COM1C1 3
+#define TOV3   0
+#define OCF3A  1
+#define TOIE3  0
+#define OCIE3A 1
+#define WGM32  3
+#define CS30   0
+#define CS31   1
+#define CS32   2
+#define INTF0  0
+#define INTF1  1
+#define INTF2  2
+#define INTF3  3
+#define INTF6  6
+#define PCIE0  0
+#define PCIF0  0
+
+uint16_t host_tcnt1_read();             // called for each read of TCNT1, default: advances by 7 ticks per read
+void     host_tcnt1_write(uint16_t c);  // called for each write of TCNT1
+
+// core functions:
+
+void pinMode(uint8_t pin, uint8_t mode);
+int  digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t x);
+int  digitalPinToInterrupt(int pin);
+void attachInterrupt(int irq, void (*f)(), int mode);
+void detachInterrupt(int irq);
+
+volatile uint8_t *digitalPinToPCICR(int pin);
+int               digitalPinToPCICRbit(int pin);
+volatile uint8_t *digitalPinToPCMSK(int pin);
+int               digitalPinToPCMSKbit(int pin);
+
+unsigned long millis();
+unsigned long micros();
+void          delay(unsigned long ms);
+void          delayMicroseconds(unsigned int us);
+
+char *ltoa(long v, char *s, int radix);
+char *ultoa(unsigned long v, char *s, int radix);
+
+struct Print  // output goes to stdout while host_print is set
+{
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *b, size_t n);
+    size_t write(const char *s);
+    size_t print(const char *s);
+    size_t print(char c);
+    size_t print(long v, int radix = DEC);
+    size_t print(unsigned long v, int radix = DEC);
+    size_t print(int v, int radix = DEC);
+    size_t print(unsigned int v, int radix = DEC);
+    size_t print(unsigned char v, int radix = DEC);
+    size_t println();
+    size_t println(const char *s);
+    size_t println(long v, int radix = DEC);
+    size_t println(unsigned long v, int radix = DEC);
+    size_t println(int v, int radix = DEC);
+    size_t println(unsigned int v, int radix = DEC);
+    size_t println(unsigned char v, int radix = DEC);
+    void   flush();
+    int    availableForWrite();
+};
+
+struct Stream : Print  // input comes from host_read, if set
+{
+    int available();
+    int read();
+    int peek();
+};
+
+struct HardwareSerial : Stream
+{
+    void begin(unsigned long baud);
+    void end();
+    operator bool();
+};
+
+extern HardwareSerial Serial;
+
+extern bool host_print;         // print sketch output to stdout, CR dropped
+extern int (*host_read)();      // byte source for Stream::read() and available(), -1 = none
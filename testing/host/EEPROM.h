@@ -0,0 +1,20 @@
+// description: host stand-in for the Arduino EEPROM library, backed by host_eeprom (zeroed at start)
+
+#pragma once
+
+#include <Arduino.h>
+
+#define EEPROM_SIZE 1024  // ATmega32u4
+
+extern uint8_t host_eeprom[EEPROM_SIZE];
+
+struct EEPROMClass
+{
+    template <class T> T &get(const int a, T &t) { memcpy(&t, host_eeprom + a, sizeof(T)); return t; }
+    template <class T> const T &put(const int a, const T &t) { memcpy(host_eeprom + a, &t, sizeof(T)); return t; }
+    uint8_t read(const int a) { return host_eeprom[a]; }
+    void update(const int a, const uint8_t x) { host_eeprom[a] = x; }
+    void write(const int a, const uint8_t x) { host_eeprom[a] = x; }
+};
+
+extern EEPROMClass EEPROM;
@@ -0,0 +1,58 @@
+// description: host stand-in for the Arduino Ethernet library, no hardware present (begin() fails, nothing connects)
+
+#pragma once
+
+#include <Arduino.h>
+
+#define MAX_SOCK_NUM 4
+
+struct IPAddress
+{
+    uint32_t a;
+    IPAddress() : a(0) {}
+    IPAddress(const uint32_t a) : a(a) {}
+    operator uint32_t() const { return a; }
+};
+
+struct EthernetClient : Stream
+{
+    EthernetClient() {}
+    EthernetClient(uint8_t) {}
+    operator bool() { return false; }
+    uint8_t getSocketNumber() const { return MAX_SOCK_NUM; }
+    int connected() { return 0; }
+    void stop() {}
+};
+
+struct EthernetServer
+{
+    EthernetServer(uint16_t) {}
+    EthernetClient available() { return EthernetClient(); }
+    void begin() {}
+};
+
+struct EthernetUDP : Stream
+{
+    uint8_t begin(uint16_t) { return 1; }
+    int beginPacket(IPAddress, uint16_t) { return 1; }
+    int endPacket() { return 1; }
+};
+
+struct SPIClass  // included by the real Ethernet.h
+{
+    void usingInterrupt(uint8_t) {}
+};
+
+extern SPIClass SPI;
+
+struct EthernetClass
+{
+    int begin(uint8_t *) { return 0; }
+    void begin(uint8_t *, IPAddress, IPAddress, IPAddress, IPAddress) {}
+    int maintain() { return 0; }
+    IPAddress localIP() { return IPAddress(); }
+    IPAddress gatewayIP() { return IPAddress(); }
+    IPAddress subnetMask() { return IPAddress(); }
+};
+
+extern EthernetClass Ethernet;
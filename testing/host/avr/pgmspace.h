@@ -0,0 +1,3 @@
+#pragma once
+
+#include <Arduino.h>  // PROGMEM and pgm_read_*() are defined there
@@ -0,0 +1,6 @@
+#pragma once
+
+#define WDTO_1S 6
+
+void wdt_enable(int timeout);
+void wdt_disable();
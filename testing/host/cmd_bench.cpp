@@ -0,0 +1,88 @@
+// description: host benchmark of SCPI command dispatch (parse_msg) in commands/s, driver for sketch.py
+
+// build:
+//   python3 sketch.py ../../instruments/arduino/<sketch>/<sketch>.ino cmd_bench.cpp cmd_bench -O2
+
+// usage:
+//   python3 commands.py <sketch> | ./cmd_bench [reps]     time reps passes over the corpus (default 2000), replies discarded
+//   python3 commands.py <sketch> | ./cmd_bench replies    print each command and its reply, to diff two versions of a sketch
+
+// notes:
+//   - for before/after numbers, build the same driver against the sketch of both commits (e.g. from git worktree add)
+//   - the timed passes skip *TRG, BAUD, and LAN commands, which do more than dispatch
+//   - EEPROM reply strings are short tags (E_CMD, E_ARG, ...) rather than the texts written by eeprom/eeprom.ino
+//   - host numbers understate the gain on the AVR, where strlen/strncasecmp are relatively more expensive
+
+#include <stdio.h>
+#include <time.h>
+
+static void host_eps(const int a, const char *s) { strcpy((char *)host_eeprom + a, s); }
+
+int main(int argc, char **argv)
+{
+    scpi_default(scpi);
+    EEPROM.put(EPA_SCPI, scpi);
+    host_eps(EPA_IDN,               "IDN");
+    host_eps(EPA_REPLY_READONLY,    "E_RO");
+    host_eps(EPA_REPLY_INVALID_CMD, "E_CMD");
+    host_eps(EPA_REPLY_INVALID_ARG, "E_ARG");
+    host_eps(EPA_REPLY_REBOOT_REQ,  "REBOOT_REQ");
+    host_eps(EPA_REPLY_REBOOTING,   "REBOOTING");
+#ifdef EPA_REPLY_BUSY
+    host_eps(EPA_REPLY_BUSY,        "E_BUSY");
+#endif
+#ifdef EPA_REPLY_CHECK
+    host_eps(EPA_REPLY_CHECK,       "E_CHECK");
+#endif
+#ifdef EPA_REPLY_PENDING
+    host_eps(EPA_REPLY_PENDING,     "E_PEND");
+#endif
+    const long baud = 9600;
+    EEPROM.put(EPA_SERIAL_BAUD, baud);
+    setup();
+    lan = 0;
+
+    const bool replies = argc > 1 && !strcmp(argv[1], "replies");
+    const int  reps    = argc > 1 && !replies ? atoi(argv[1]) : 2000;
+
+    static char cmds[8192][MSGLEN];
+    int  ncmd = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), stdin))
+    {
+        line[strcspn(line, "\r\n")] = 0;
+        if (replies)
+        {
+            if (!line[0]) { continue; }
+            printf("> %s\n", line);
+            host_print = 1;
+            parse_msg(line);
+            host_print = 0;
+            fflush(stdout);
+        }
+        else if (line[0] && !strstr(line, "*TRG") && !strstr(line, "BAUD ") && !strstr(line, ":LAN:") && ncmd < 8192)
+        {
+            line[MSGLEN - 1] = 0;
+            strcpy(cmds[ncmd], line);
+            ncmd++;
+        }
+    }
+    if (replies) { return 0; }
+
+    char msg[MSGLEN];
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int r = 0; r < reps; r++)
+    {
+        for (int c = 0; c < ncmd; c++)
+        {
+            memcpy(msg, cmds[c], MSGLEN);  // parse_msg() may split the message in place
+            parse_msg(msg);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    const double dt = (t1.tv_sec - t0.tv_sec) + 1e-9 * (t1.tv_nsec - t0.tv_nsec);
+    printf("%d commands x %d: %.2fM commands/s\n", ncmd, reps, ncmd * reps / dt / 1e6);
+    return 0;
+}
@@ -0,0 +1,92 @@
+# description: generates a corpus of SCPI commands for one instrument, one per line, for cmd_bench.cpp
+
+# usage:
+#   python3 commands.py <pulsegen|detectron|slowdio> > <file>
+
+# notes:
+#   - every command in long, short, and lowercase form, with valid and invalid arguments, bad suffixes, and junk separators,
+#     plus numbered channels in and out of range
+#   - commands that reboot the board or upload a :PULSe<n>:LIST block are left out
+
+import re
+import sys
+
+inst = sys.argv[1]
+# (path, [set args]); path uses SCPI case notation, <n> numeric suffix
+common = [
+ ('*IDN', None), ('*SAV', None), ('*RCL', None), ('*RST', None),
+ (':SYSTem:COMMunicate:SERial:BAUD', ['9600', '115200', '100', 'x', '']),
+ (':SYSTem:COMMunicate:LAN:MODe', ['OFF', 'DHCP', 'STATIC', 'STAT', 'stat', 'bad']),
+ (':SYSTem:COMMunicate:LAN:MAC', ['1A:2B:3C:4D:5E:6F', '1:2:3', 'zz']),
+ (':SYSTem:COMMunicate:LAN:IP', ['1.2.3.4']),
+ (':SYSTem:COMMunicate:LAN:GATEway', ['1.2.3.4']),
+ (':SYSTem:COMMunicate:LAN:SUBnet', ['1.2.3.4']),
+ (':SYSTem:COMMunicate:LAN:IP:STATic', ['192.168.0.5', '1.2.3', '300.1.1.1']),
+ (':SYSTem:COMMunicate:LAN:GATEway:STATic', ['192.168.0.1']),
+ (':SYSTem:COMMunicate:LAN:SUBnet:STATic', ['255.255.255.0']),
+]
+b01 = ['0', '1', '2', 'x']
+if inst == 'pulsegen':
+    cmds = common + [('*TRG', None), (':ABORt', None),
+     (':CLOCK:SRC', ['INT', 'INTERNAL', 'EXT', 'ext', 'foo']), (':CLOCK:EDGE', ['RIS', 'RISING', 'FALL', 'falling', 'x']),
+     (':CLOCK:FREQuency', ['5']), (':CLOCK:FREQuency:INTernal', ['5']), (':CLOCK:FREQuency:EXTernal', ['10000000', '0', '1e6', '2.5e6', 'x']),
+     (':CLOCK:FREQuency:MEASure', ['1']), (':CLOCK:FREQuency:MEASure:GATE', ['0.1', '1', '0', '100']), (':CLOCK:FREQuency:MEASure:ADEV', ['1']),
+     (':TRIGger:EDGE', ['RIS', 'FALL', 'x']), (':TRIGger:ARMed', b01), (':TRIGger:READY', ['1']), (':TRIGger:BUSY', ['1']), (':TRIGger:REARM', b01), (':TRIGger:COUNt', ['1']),
+     (':SEQuence:STORe', ['1', '2', '0', '99', 'x']), (':SEQuence:LENgth', ['0', '2', '99']), (':SEQuence:INDex', ['1', '2', '0']),
+     (':CONFigure:COMMit', None), (':CONFigure:AUTO', b01), (':CONFigure:PENDing', ['1']),
+     (':DIAGnostic:LATency', ['1']), (':DIAGnostic:LATency:HISTogram', ['1']), (':DIAGnostic:LATency:CLEar', None), (':DIAGnostic:LATency:AUTO', b01), (':DIAGnostic:LATency:OFFSet', ['1']),
+     (':PULSe<n>:DELay', ['0', '0.001', '1.5e-3', '-1', 'x']), (':PULSe<n>:WIDth', ['0.0001', '0', '1e-6']), (':PULSe<n>:PERiod', ['0.01', '0']), (':PULSe<n>:CYCles', ['0', '3', '-1']),
+     (':PULSe<n>:DRIVe', ['SW', 'HW', 'xx']), (':PULSe<n>:MODe', ['TRAIN', 'LIST', 'x']), (':PULSe<n>:LIST', []), (':PULSe<n>:LIST:COUNt', ['1']),
+     (':PULSe<n>:INVert', b01), (':PULSe<n>:VALid', ['1']), (':PULSe<n>:ERRor', ['1'])]
+    nrange = [1, 2, 4]; nbad = ['', '0', '5', '12']
+elif inst == 'detectron':
+    cmds = common + [('*TRG', None),
+     (':INput<n>:MODe', ['OFF', 'RIS', 'FALLING', 'CHA', 'COUNTER', 'coun', 'x']), (':INput<n>:PULLup', b01), (':INput<n>:INVert', b01),
+     (':INput<n>:COUNt', ['1']), (':INput<n>:VALue', ['1']), (':INput<n>:RATE', ['1']), (':INput<n>:HISTogram', ['1']), (':INput<n>:HISTogram:CLEar', None),
+     (':INput<n>:FILTer', ['0', '0.001', '2']), (':INput<n>:REJected', ['1']), (':INput<n>:FREQuency', ['1']),
+     (':INput:RATE', ['1']), (':INput:GATE', ['0.5', '0.001', '100']), (':INput:WINDow', ['0.08', '0.01', '1']),
+     (':COINcidence<g>:MASK', ['1,2', '1', 'NONE', '1,2,9', 'x']), (':COINcidence<g>:COUNt', ['1']),
+     (':COINcidence:WINDow', ['0.001', '2']), (':COINcidence:ONLY', b01),
+     (':OUTput:SERial:ENable', b01), (':OUTput:SERial:FORMat', ['TEXT', 'BIN', 'BINARY', 'x']),
+     (':OUTput:UDP:ENable', b01), (':OUTput:UDP:DESTination', ['1.2.3.4', 'x']), (':OUTput:UDP:PORT', ['5000', '0', '70000']),
+     (':OUTput:UDP:BATCh', ['0', '32', '33']), (':OUTput:UDP:LATency', ['0.01', '20']),
+     (':EVENt:OVERflow', ['1']), (':DATA:ENable', b01), (':DATA:COUNt', ['1']), (':DATA:OVERflow', ['1']), (':DATA:FETCh', []), (':DATA:CLEar', None)]
+    nrange = [1, 3, 8]; nbad = ['0', '9', '12']
+else:
+    cmds = common + [(':DIO<n>:DIRection', ['IN', 'INPUT', 'OUT', 'output', 'x']), (':DIO<n>:INVert', b01),
+     (':DIO<n>:INput:PULLup', b01), (':DIO<n>:INput:VALue', ['1']), (':DIO<n>:OUTput:VALue', b01), (':DIO<n>:VALue', b01)]
+    nrange = [1, 7]; nbad = ['', '0', '8']
+
+def forms(path) :
+    longf = path.upper()
+    shortf = ':'.join(re.sub('[a-z]', '', p) for p in path.split(':'))
+    mixed = path.lower()
+    return [longf, shortf, mixed]
+
+out = []
+for (path, args) in cmds :
+    paths = []
+    if '<n>' in path or '<g>' in path :
+        tag = '<n>' if '<n>' in path else '<g>'
+        rng = nrange if tag == '<n>' else [1, 4]
+        bad = nbad if tag == '<n>' else ['0', '5']
+        for k in rng : paths.append(path.replace(tag, str(k)))
+        for k in bad : out.append(path.replace(tag, k).upper() + '?')
+    else : paths.append(path)
+    for p in paths :
+        for f in forms(p) :
+            out.append(f + '?')
+            if args is None : out.append(f)
+            else :
+                for a in args : out.append(f + ' ' + a)
+            out.append(f + 'X?')
+            out.append(f + '? 3')
+            out.append(f + ':')
+        out.append(p + '?x')
+        out.append(p + ' ')
+# extra fetch forms and junk
+out += [':DATA:FETCh? 2', ':DATA:FETC? x', ':SYST:COMM:LAN', ':SYST:COMM:LAN:', '', ' ', ':', '::', '*idn?', '*IDN', '*IDNX?', 'SYST:COMM:SER:BAUD?', ':SYST:COMMUNICATEX:SER:BAUD?', ':SYSTE:COMM:SER:BAUD?']
+for o in out :
+    if 'REB' in o.upper() : continue
+    if inst == 'pulsegen' and re.search(r'LIST #', o) : continue
+    print(o)
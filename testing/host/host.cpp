@@ -0,0 +1,169 @@
+// description: definitions for the host stand-ins in Arduino.h, EEPROM.h, and Ethernet.h
+
+// notes:
+//   - linked into every sketch build by sketch.py, drivers may replace the weak functions (e.g. to model Timer1)
+//   - pins read their PINx bit (low unless a driver sets it), time stands still (millis() and micros() return 0),
+//     and the watchdog never fires
+
+#include <stdio.h>
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Ethernet.h>
+#include <avr/wdt.h>
+
+volatile uint8_t PORTB, PORTC, PORTD, PORTE, PORTF;
+volatile uint8_t PINB,  PINC,  PIND,  PINE,  PINF;
+volatile uint8_t DDRB,  DDRC,  DDRD,  DDRE,  DDRF;
+
+volatile uint8_t  TCCR1A, TCCR1B, TCCR1C, TIMSK1;
+Tifr              TIFR1;
+Tcnt              TCNT1;
+volatile uint16_t OCR1A, OCR1B, OCR1C, ICR1;
+
+volatile uint8_t  TCCR3A, TCCR3B, TCCR3C, TIMSK3, TIFR3;
+volatile uint16_t TCNT3, OCR3A, OCR3B;
+
+volatile uint8_t EIFR, EIMSK, EICRA, EICRB, PCICR, PCMSK0, PCIFR, SREG;
+
+static uint16_t tcnt1;
+
+__attribute__((weak)) uint16_t host_tcnt1_read()          { return tcnt1 += 7; }
+__attribute__((weak)) void     host_tcnt1_write(uint16_t c) { tcnt1 = c; }
+
+Tcnt::operator uint16_t() const         { return host_tcnt1_read(); }
+Tcnt &Tcnt::operator=(const uint16_t c) { host_tcnt1_write(c); return *this; }
+
+bool host_print = 0;
+int (*host_read)() = 0;
+
+uint8_t     host_eeprom[EEPROM_SIZE];
+EEPROMClass EEPROM;
+
+HardwareSerial Serial;
+EthernetClass  Ethernet;
+SPIClass       SPI;
+
+// pins as on the Leonardo (variants/leonardo/pins_arduino.h), D0 to D13, D14 to D17 on ICSP, A0 to A5 as D18 to D23:
+
+#define NPIN 24
+
+static volatile uint8_t * const pin_port[NPIN] = {&PORTD, &PORTD, &PORTD, &PORTD, &PORTD, &PORTC, &PORTD, &PORTE, &PORTB, &PORTB, &PORTB, &PORTB,
+                                                  &PORTD, &PORTC, &PORTB, &PORTB, &PORTB, &PORTB, &PORTF, &PORTF, &PORTF, &PORTF, &PORTF, &PORTF};
+static volatile uint8_t * const pin_in[NPIN]   = {&PIND,  &PIND,  &PIND,  &PIND,  &PIND,  &PINC,  &PIND,  &PINE,  &PINB,  &PINB,  &PINB,  &PINB,
+                                                  &PIND,  &PINC,  &PINB,  &PINB,  &PINB,  &PINB,  &PINF,  &PINF,  &PINF,  &PINF,  &PINF,  &PINF};
+static volatile uint8_t * const pin_ddr[NPIN]  = {&DDRD,  &DDRD,  &DDRD,  &DDRD,  &DDRD,  &DDRC,  &DDRD,  &DDRE,  &DDRB,  &DDRB,  &DDRB,  &DDRB,
+                                                  &DDRD,  &DDRC,  &DDRB,  &DDRB,  &DDRB,  &DDRB,  &DDRF,  &DDRF,  &DDRF,  &DDRF,  &DDRF,  &DDRF};
+static const uint8_t pin_mask[NPIN] PROGMEM    = {1 << 2, 1 << 3, 1 << 1, 1 << 0, 1 << 4, 1 << 6, 1 << 7, 1 << 6, 1 << 4, 1 << 5, 1 << 6, 1 << 7,
+                                                  1 << 6, 1 << 7, 1 << 3, 1 << 1, 1 << 2, 1 << 0, 1 << 7, 1 << 6, 1 << 5, 1 << 4, 1 << 1, 1 << 0};
+static const uint8_t pin_pwm[NPIN] PROGMEM     = {0, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};  // on a timer output
+
+static void turn_off_pwm(const uint8_t) {}  // the core clears the COMnx bits here, on the host there is nothing to clear
+
+void pinMode(const uint8_t pin, const uint8_t mode)
+{
+    if (pin >= NPIN) { return; }
+    const uint8_t m = pgm_read_byte(pin_mask + pin);
+    const uint8_t s = SREG;
+    cli();
+    if (mode == OUTPUT) { *pin_ddr[pin] |=  m; }
+    else                { *pin_ddr[pin] &= ~m; if (mode == INPUT_PULLUP) { *pin_port[pin] |= m; } else { *pin_port[pin] &= ~m; } }
+    SREG = s;
+}
+
+int digitalRead(const uint8_t pin)  // same steps as the core: table lookups, PWM check, then the port read
+{
+    if (pin >= NPIN) { return LOW; }
+    const uint8_t m = pgm_read_byte(pin_mask + pin);
+    if (pgm_read_byte(pin_pwm + pin)) { turn_off_pwm(pin); }
+    return (*pin_in[pin] & m) ? HIGH : LOW;
+}
+
+void digitalWrite(const uint8_t pin, const uint8_t x)
+{
+    if (pin >= NPIN) { return; }
+    const uint8_t m = pgm_read_byte(pin_mask + pin);
+    if (pgm_read_byte(pin_pwm + pin)) { turn_off_pwm(pin); }
+    const uint8_t s = SREG;
+    cli();
+    if (x == LOW) { *pin_port[pin] &= ~m; }
+    else          { *pin_port[pin] |=  m; }
+    SREG = s;
+}
+
+int  digitalPinToInterrupt(const int pin)   { return pin == 2 ? 1 : pin == 3 ? 0 : pin == 7 ? 4 : NOT_AN_INTERRUPT; }  // Leonardo
+void attachInterrupt(int, void (*)(), int) {}
+void detachInterrupt(int)                  {}
+
+volatile uint8_t *digitalPinToPCICR(const int pin)    { return (pin == 8 || pin == 9) ? &PCICR  : 0; }
+int               digitalPinToPCICRbit(int)           { return 0; }
+volatile uint8_t *digitalPinToPCMSK(const int pin)    { return (pin == 8 || pin == 9) ? &PCMSK0 : 0; }
+int               digitalPinToPCMSKbit(const int pin) { return pin == 8 ? 4 : 5; }
+
+unsigned long millis()            { return 0; }
+unsigned long micros()            { return 0; }
+void          delay(unsigned long) {}
+void          delayMicroseconds(unsigned int) {}
+
+void wdt_enable(int) {}
+void wdt_disable()   {}
+
+char *ltoa(const long v, char *s, const int radix)           { sprintf(s, radix == HEX ? "%lX" : "%ld", v); return s; }
+char *ultoa(const unsigned long v, char *s, const int radix) { sprintf(s, radix == HEX ? "%lX" : "%lu", v); return s; }
+
+// Print, Stream, and HardwareSerial:
+
+size_t Print::write(const uint8_t c)
+{
+    if (host_print && c != '\r') { putchar(c); }
+    return 1;
+}
+
+size_t Print::write(const uint8_t *b, const size_t n)
+{
+    for (size_t i = 0; i < n; i++) { write(b[i]); }
+    return n;
+}
+
+size_t Print::write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+
+size_t Print::print(const char *s) { return write(s); }
+size_t Print::print(const char c)  { return write((uint8_t)c); }
+
+size_t Print::print(const long v, const int radix)          { char s[24]; return write(ltoa(v, s, radix)); }
+size_t Print::print(const unsigned long v, const int radix) { char s[24]; return write(ultoa(v, s, radix)); }
+size_t Print::print(const int v, const int radix)           { return print((long)v, radix); }
+size_t Print::print(const unsigned int v, const int radix)  { return print((unsigned long)v, radix); }
+size_t Print::print(const unsigned char v, const int radix) { return print((unsigned long)v, radix); }
+
+size_t Print::println()                                       { return write("\r\n"); }
+size_t Print::println(const char *s)                          { return print(s) + println(); }
+size_t Print::println(const long v, const int radix)          { return print(v, radix) + println(); }
+size_t Print::println(const unsigned long v, const int radix) { return print(v, radix) + println(); }
+size_t Print::println(const int v, const int radix)           { return print(v, radix) + println(); }
+size_t Print::println(const unsigned int v, const int radix)  { return print(v, radix) + println(); }
+size_t Print::println(const unsigned char v, const int radix) { return print(v, radix) + println(); }
+
+void Print::flush()             {}
+int  Print::availableForWrite() { return 64; }
+
+static int peeked = -1;
+
+int Stream::available()
+{
+    if (peeked < 0 && host_read) { peeked = host_read(); }
+    return peeked >= 0;
+}
+
+int Stream::read()
+{
+    const int c = available() ? peeked : -1;
+    peeked = -1;
+    return c;
+}
+
+int Stream::peek() { return available() ? peeked : -1; }
+
+void HardwareSerial::begin(unsigned long) {}
+void HardwareSerial::end()                {}
+HardwareSerial::operator bool()           { return true; }
@@ -0,0 +1,185 @@
+// description: host fuzz and benchmark harness for the numeric lexer in parse.h (parse_num, parse_micros, parse_hertz)
+
+// build:
+//   g++ -O2 -std=gnu++11 -I. -I../../instruments/arduino/pulsegen -o num_fuzz num_fuzz.cpp
+
+// usage:
+//   ./num_fuzz [n] | python3 num_fuzz.py     check n random and boundary inputs (default 1000000) against Python's Decimal
+//   ./num_fuzz bench                         ns per parse_micros() for the lexer and for the parser it replaced
+
+// notes:
+//   - each input is printed as "kind<TAB>input<TAB>ok<TAB>value", kind N (parse_num), U (parse_micros), or H (parse_hertz),
+//     all with range -NUM_MAX to NUM_MAX and DEFault 42
+//   - inputs are glued from atoms (digits, signs, exponents, units, keywords, junk), built as <NRf> with random units,
+//     or placed next to the 31-bit overflow and half-up rounding boundaries
+//   - the random sequence is fixed (xorshift with a constant seed), so runs are repeatable
+//   - the old parser is kept below for the benchmark only (it takes no sign, unit, or keyword)
+
+#include <stdio.h>
+#include <time.h>
+
+#include <Arduino.h>
+#include "parse.h"
+
+namespace old
+{
+    long pow10(const long x, const int z)
+    {
+        long y = 1;
+        for (int i = 0; i < abs(z); i++) { y *= 10; }
+        return (z < 0) ? x / y : x * y;
+    }
+
+    bool parse_num(const char *str, long &value, const bool zero_ok, const int exp)
+    {
+        int len = strlen(str);
+        int dpt = -1;  // first occurance of decimal point
+        int ept = -1;  // first occurance of exponent symbol
+        for (int i = 0; i < len; i++)
+        {
+            if (dpt == -1 && str[i] == '.')                    { dpt = i; }
+            if (ept == -1 && (str[i] == 'e' || str[i] == 'E')) { ept = i; }
+        }
+
+        long a = atol(str);
+        if (a < 0 || (a == 0 && str[0] != '0' && str[0] != '.')) { return 0; }
+
+        long b = 0;
+        if (dpt != -1)
+        {
+            const char *str_p = str + dpt + 1;
+            b = atol(str_p);
+            if (b < 0 || (b == 0 && str_p[0] != '0')) { return 0; }
+        }
+
+        int c = 0;
+        if (ept != -1)
+        {
+            const char *str_p = str + ept + 1;
+            c = atoi(str_p);
+            if (c == 0 && str_p[0] != '0') { return 0; }
+        }
+
+        if (a > 0 || b > 0 || zero_ok)
+        {
+            int dig = (dpt == -1) ? 0 : ((ept == -1) ? len - dpt - 1 : ept - dpt - 1);
+            value = pow10(a, c + exp) + pow10(b, c + exp - dig);
+            return 1;
+        }
+        else { return 0; }
+    }
+
+    bool parse_micros(const char *str, long &value, bool zero_ok) { return parse_num(str, value, zero_ok, 6); }
+}
+
+static unsigned long long rs = 88172645463325252ULL;
+
+static unsigned rnd(const unsigned n)  // xorshift64
+{
+    rs ^= rs << 13;
+    rs ^= rs >> 7;
+    rs ^= rs << 17;
+    return (unsigned)(rs % n);
+}
+
+static const char *atoms[] = {"0", "1", "5", "9", "4", "49", "50", "99", "2147483647", "2147483648", "214748364", "0000", "000000000001",
+                              ".", "e", "E", "-", "+", "e-", "e+", "E9", "e-6", "e10", "e1000", "e-1000", "e99999", "MS", "us", "S", "ns",
+                              "kHz", "MHZ", "HZ", " ", "x", "9999999999", "MIN", "MAX", "DEF", "MINIMUM", "maximum", "Default",
+                              "5", "3", "7", "2", "6", "8"};
+
+static const char *signs[] = {"", "-", "+"};
+static const char *units[] = {"s", "ms", "us", "ns", " s", " ms", "  us", "Hz", "kHz", "MHZ", " khz"};
+
+static void make_boundary(char *buf, const int size)  // around NUM_MAX, with digits that round either way
+{
+    char d[32];
+    const unsigned long long x = NUM_MAX - 3 + rnd(7);
+    const int dl = snprintf(d, sizeof(d), "%llu%s", x, rnd(2) ? "5" : (rnd(2) ? "49999" : "50000"));
+    int ip = dl - rnd(12);  // digits in front of the point
+    if (ip < 1) { ip = 1; }
+
+    int len = 0;
+    memcpy(buf, d, ip);                 len += ip;
+    buf[len++] = '.';
+    memcpy(buf + len, d + ip, dl - ip); len += dl - ip;
+    buf[len] = 0;
+    if (rnd(2)) { snprintf(buf + len, size - len, "e%d", (int)rnd(20) - 10); }
+}
+
+static void make_nrf(char *buf, const int size)  // well-formed <NRf>, sometimes with a unit
+{
+    int len = snprintf(buf, size, "%s", signs[rnd(3)]);
+    for (int j = rnd(14); j > 0; j--) { buf[len++] = '0' + rnd(10); }
+    if (rnd(2))
+    {
+        buf[len++] = '.';
+        for (int j = rnd(14); j > 0; j--) { buf[len++] = '0' + rnd(10); }
+    }
+    if (rnd(2))
+    {
+        buf[len++] = rnd(2) ? 'e' : 'E';
+        if (rnd(2)) { buf[len++] = rnd(2) ? '-' : '+'; }
+        for (int j = 1 + rnd(3); j > 0; j--) { buf[len++] = '0' + rnd(10); }
+    }
+    buf[len] = 0;
+    if (rnd(2)) { snprintf(buf + len, size - len, "%s", units[rnd(sizeof(units) / sizeof(*units))]); }
+}
+
+static void make_atoms(char *buf, const int size)  // mostly junk
+{
+    int len = 0;
+    buf[0] = 0;
+    for (int j = 1 + rnd(5); j > 0; j--)
+    {
+        const char *a = atoms[rnd(sizeof(atoms) / sizeof(*atoms))];
+        if (len + (int)strlen(a) >= size - 6) { break; }
+        strcpy(buf + len, a);
+        len += strlen(a);
+    }
+}
+
+static void fuzz(const long n)
+{
+    char buf[96];
+    for (long i = 0; i < n; i++)
+    {
+        if      (rnd(8) == 0) { make_boundary(buf, sizeof(buf)); }
+        else if (rnd(4) == 0) { make_nrf(buf, sizeof(buf));      }
+        else                  { make_atoms(buf, sizeof(buf));    }
+
+        long v  = 0;
+        bool ok = 0;
+        char kind;
+        switch (i % 3)
+        {
+            case 0:  kind = 'N'; ok = parse_num(buf, v, -NUM_MAX, NUM_MAX, 42);    break;
+            case 1:  kind = 'U'; ok = parse_micros(buf, v, -NUM_MAX, NUM_MAX, 42); break;
+            default: kind = 'H'; ok = parse_hertz(buf, v, -NUM_MAX, NUM_MAX, 42);  break;
+        }
+        printf("%c\t%s\t%d\t%ld\n", kind, buf, ok, ok ? v : 0);
+    }
+}
+
+static void bench()
+{
+    const char *in[] = {"0.001", "1.5e-3", "20000", "0.5", "2.5e6", "100e-6", "0.000123", "60"};
+    const int  N     = 4000000;
+    long v, sum = 0;
+
+    clock_t t = clock();
+    for (int i = 0; i < N; i++) { old::parse_micros(in[i & 7], v, 1); sum += v; }
+    const double a = double(clock() - t) / CLOCKS_PER_SEC;
+
+    t = clock();
+    for (int i = 0; i < N; i++) { parse_micros(in[i & 7], v, 0, NUM_MAX, 0); sum += v; }
+    const double b = double(clock() - t) / CLOCKS_PER_SEC;
+
+    printf("old %.1f ns/parse, new %.1f ns/parse (checksum %ld)\n", a / N * 1e9, b / N * 1e9, sum);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "bench")) { bench(); }
+    else                                       { fuzz(argc > 1 ? atol(argv[1]) : 1000000); }
+    return 0;
+}
@@ -0,0 +1,54 @@
+# description: reference for num_fuzz.cpp, parses each input exactly with Python's Decimal and reports mismatches
+
+# usage:
+#   ./num_fuzz [n] | python3 num_fuzz.py
+
+# notes:
+#   - follows the notes in instruments/arduino/*/eeprom/shared.h: <NRf> with optional unit (spaces allowed in between),
+#     MINimum, MAXimum, DEFault, round half up (away from zero for negative numbers), reject anything beyond NUM_MAX
+#   - exits with status 1 on any mismatch
+
+import re
+import sys
+from decimal import Decimal, getcontext, ROUND_HALF_UP
+
+getcontext().prec = 20000
+getcontext().Emax = 10**6
+getcontext().Emin = -10**6
+
+NUM_MAX = 2**31 - 1
+DEF     = 42
+UNITS   = {'N': {}, 'U': {'S': 0, 'MS': -3, 'US': -6, 'NS': -9}, 'H': {'HZ': 0, 'KHZ': 3, 'MHZ': 6}}
+EXP     = {'N': 0, 'U': 6, 'H': 0}
+
+nrf = re.compile(r'^([+-]?)(\d+\.?\d*|\.\d+)([eE][+-]?\d+)? *(.*)$')
+
+def ref(kind, s) :  # value, or None if rejected
+    u = s.upper()
+    if u in ('MIN', 'MINIMUM') : return -NUM_MAX
+    if u in ('MAX', 'MAXIMUM') : return NUM_MAX
+    if u in ('DEF', 'DEFAULT') : return DEF
+    m = nrf.match(s)
+    if not m : return None
+    unit = m.group(4).upper()
+    if unit and unit not in UNITS[kind] : return None
+    e = EXP[kind] + (UNITS[kind][unit] if unit else 0)
+    x = int(m.group(3)[1:]) if m.group(3) else 0
+    x = max(-10**5, min(10**5, x))
+    d = Decimal(m.group(1) + m.group(2)).scaleb(e + x)
+    if d.copy_abs() > NUM_MAX + 1 : return None
+    v = int(d.copy_abs().quantize(Decimal(1), rounding=ROUND_HALF_UP)) * (-1 if m.group(1) == '-' else 1)
+    return v if abs(v) <= NUM_MAX else None
+
+n = valid = bad = 0
+for line in sys.stdin :
+    kind, s, ok, v = line.rstrip('\n').split('\t')
+    r   = ref(kind, s)
+    got = int(v) if ok == '1' else None
+    n += 1
+    if r is not None : valid += 1
+    if r != got :
+        bad += 1
+        if bad <= 20 : print('MISMATCH %s %r got %s ref %s' % (kind, s, got, r))
+print('%d inputs, %d valid, %d mismatches' % (n, valid, bad))
+sys.exit(1 if bad else 0)
@@ -0,0 +1,81 @@
+// description: host microbenchmark of the detectron input snapshot, pack_inputs() against the digitalRead() loop it replaced
+
+// build:
+//   python3 sketch.py ../../instruments/arduino/detectron/detectron.ino pack_bench.cpp pack_bench -O2
+
+// usage:
+//   ./pack_bench [n]     check both paths agree on n random pin levels and INVert settings (default 1000000), then time them
+
+// notes:
+//   - digitalRead() in host.cpp takes the same steps as the Arduino core (pin tables, PWM check, port read)
+//   - port reads are counted per snapshot: the old path reads one PINx per input, spread over eight digitalRead() calls,
+//     the new one reads each distinct PINx once, back to back
+//   - host timings only give a ratio, not AVR cycles
+
+#include <stdio.h>
+#include <time.h>
+
+byte old_pack_inputs()  // as before the port snapshot
+{
+    byte y = 0;
+    for (int n = 0; n < NCHAN; n++)
+    {
+        const bool x_raw = digitalRead(conf_input_pin[n]);
+        y |= (scpi.input_invert[n] ? !x_raw : x_raw) << n;
+    }
+    return y;
+}
+
+static unsigned long long rs = 88172645463325252ULL;
+
+static unsigned rnd(const unsigned n)  // xorshift64
+{
+    rs ^= rs << 13;
+    rs ^= rs >> 7;
+    rs ^= rs << 17;
+    return (unsigned)(rs % n);
+}
+
+static void set_pins()
+{
+    PINB = rnd(256);
+    PINC = rnd(256);
+    PIND = rnd(256);
+    PINE = rnd(256);
+    PINF = rnd(256);
+}
+
+int main(int argc, char **argv)
+{
+    const long n = argc > 1 ? atol(argv[1]) : 1000000;
+
+    scpi_default(scpi);
+    setup();
+
+    long bad = 0;
+    for (long i = 0; i < n; i++)
+    {
+        if (i % 64 == 0)
+        {
+            for (int c = 0; c < NCHAN; c++) { scpi.input_invert[c] = rnd(2); }
+            update_masks();
+        }
+        set_pins();
+        if (old_pack_inputs() != pack_inputs()) { bad++; }
+    }
+    printf("%ld snapshots, %ld mismatches\n", n, bad);
+
+    const long N = 50000000;
+    byte sum = 0;
+    clock_t t = clock();
+    for (long i = 0; i < N; i++) { sum += old_pack_inputs(); }
+    const double a = double(clock() - t) / CLOCKS_PER_SEC;
+
+    t = clock();
+    for (long i = 0; i < N; i++) { sum += pack_inputs(); }
+    const double b = double(clock() - t) / CLOCKS_PER_SEC;
+
+    printf("old %.1f ns/snapshot (%d port reads), new %.1f ns/snapshot (%d port reads) (checksum %d)\n",
+           a / N * 1e9, NCHAN, b / N * 1e9, N_port, sum);
+    return bad != 0;
+}
@@ -0,0 +1,292 @@
+// description: host model of the pulsegen edge scheduler, checks the edges it writes against the ideal pulse trains
+
+// build:
+//   python3 sketch.py ../../instruments/arduino/pulsegen/pulsegen.ino sched_model.cpp sched_model -O2
+
+// usage:
+//   ./sched_model [trials] [seed]     scpi_default() first, then random configurations (default 300 trials, seed 1)
+
+// notes:
+//   - Timer1 is modelled by host_tcnt1_read(): every read of TCNT1 takes one tick, sets TOV1 on wrap and OCF1x on
+//     compare match, and pending interrupts are serviced between reads in AVR priority order (COMPA before OVF),
+//     so the real run_edges(), run_instant(), next_edge(), queue_insert() and extend_tcnt1() are what is tested
+//   - time is counted in model ticks, i.e. TCNT1 reads, lateness is therefore a measure of polling, not of CPU cycles
+//   - the reference is the pulse train as defined in eeprom/shared.h (and played by the old gen_pulses() loop):
+//     active edges at DELAY + m*PERIOD, inactive ones WIDTH later, a continuous channel (WIDTH >= PERIOD) only switches
+//     at DELAY and at DELAY + CYCLES*PERIOD, all relative to the sequence start t_start = trigger - conf_start_us
+//   - a trial fails if any channel has a missing, extra, or inverted edge, an edge early or more than MAX_LATE late,
+//     edges out of order across channels, or coincident edges on one port written apart
+//   - every third trial plays a :SEQuence slot, every fourth starts just before the 48-bit timebase wraps
+//     (c_ovf from 0xFFFFFFFF to 0, about 4.5 years after reboot at 2 MHz), so the sequence runs across the wrap
+//   - DRIVE HW (compare unit pins) is not modelled, all channels are DRIVE SW
+//   - skew: run_instant() makes one store per port with edges at that instant, in port order, so coincident edges on
+//     different ports are apart by the loop passes in between, CYC_STORE per pass that stores and CYC_SKIP per pass that
+//     does not, the worst case over all instants is reported in CPU cycles and in ns at F_CPU as a model estimate,
+//     nothing is measured on hardware
+//   - CYC_STORE and CYC_SKIP are summed from the listing below, which is hand-assembled for avr-gcc -Os (no AVR toolchain
+//     was at hand when it was written), so they are only as good as that listing; to replace it with the real one:
+//       avr-objdump -d -S pulsegen.ino.elf   (the .elf is kept by arduino-cli compile --export-binaries)
+//     find run_instant, take the port loop up to the first access of q_chan, and count cycles per the AVR instruction set
+//     manual (LD/LDD/ST 2, LDS 2, ADIW 2, taken branch 2, not taken 1, ALU 1)
+//
+//       loop:  movw r30,r28 / subi r30,lo8(-(port_set)) / sbci r31,hi8(-(port_set)) / ld r24,Z     5   port_set[p]
+//              movw r30,r28 / subi r30,lo8(-(port_clr)) / sbci r31,hi8(-(port_clr)) / ld r25,Z     5   port_clr[p]
+//              or   r24,r25                                                                        1
+//              breq next                                                                           2 taken, 1 not
+//              movw r30,r28 / add r30,r30 / adc r31,r31 / subi / sbci / ld r26,Z+ / ld r27,Z       9   X = port_addr[p]
+//              ld   r18,X                                                                          2   *port_addr[p]
+//              movw r30,r28 / subi / sbci / ld r24,Z / com r24 / and r18,r24                       7   & ~port_clr[p] (volatile, reloaded)
+//              movw r30,r28 / subi / sbci / ld r24,Z / or r18,r24                                  6   | port_set[p]  (volatile, reloaded)
+//              st   X,r18                                                                          2   the port store
+//       next:  adiw r28,1                                                                          2   p++
+//              lds  r24,N_port / lds r25,N_port+1                                                  4   reloaded, the byte store may alias it
+//              cp   r28,r24 / cpc r29,r25 / brlt loop                                              4
+//
+//     skipped pass: 5 + 5 + 1 + 2 + 2 + 4 + 4 = 23 = CYC_SKIP,
+//     store to store: 10 after the store + 5 + 5 + 1 + 1 + 9 + 2 + 7 + 6 + 2 up to the next = 48 = CYC_STORE
+
+#include <stdio.h>
+
+#undef min  // the Arduino macros break the standard library
+#undef max
+#include <algorithm>
+#include <vector>
+
+using std::max;
+
+#define MAX_LATE  4         // model ticks, an edge is written within a polling pass or two of its due time
+#define CYC_STORE 48        // CPU cycles from one port store in run_instant() to the next, if the next port has edges (listing above)
+#define CYC_SKIP  23        // CPU cycles added by a port without edges in between (listing above)
+#define F_CPU     16000000  // Leonardo
+
+struct EDGE
+{
+    unsigned long long t;  // model time, or sequence time for the reference
+    int n;
+    bool x;                // output level after the edge
+};
+
+static unsigned long long now;  // model time, 64 bits, so it keeps counting where the 48-bit timebase wraps
+static std::vector<EDGE> *seen;
+static bool level[NCHAN];
+static long stores[NCHAN + 1];  // instants by number of port stores
+static int  skew_max;           // CPU cycles from the first to the last port store of an instant
+
+static bool out(const int n) { return (*conf_pulse_port[n] & conf_pulse_mask[n]) != 0; }
+
+static void observe()
+{
+    byte ports = 0;  // stored by the instant written since the previous read
+    for (int n = 0; n < NCHAN; n++)
+    {
+        const bool x = out(n);
+        if (x != level[n])
+        {
+            if (seen) { seen->push_back({now, n, x}); }
+            level[n] = x;
+            ports |= 1 << port_idx[n];
+        }
+    }
+    if (!seen || !ports) { return; }
+
+    int count = 0, skew = 0, first = -1;
+    for (int p = 0; p < N_port; p++)
+    {
+        const bool store = (ports >> p) & 0x1;
+        if (first >= 0) { skew += store ? CYC_STORE : CYC_SKIP; }
+        if (store)      { count++; if (first < 0) { first = p; } }
+    }
+    for (int p = N_port - 1; p > first && !((ports >> p) & 0x1); p--) { skew -= CYC_SKIP; }  // passes after the last store
+    stores[count]++;
+    if (skew > skew_max) { skew_max = skew; }
+}
+
+uint16_t host_tcnt1_read()  // one tick per read, flags as the hardware sets them
+{
+    observe();  // port writes since the previous read happened at the previous tick
+    now++;
+    const uint16_t c = now;
+    if (c == 0)     { TIFR1.v |= bit(TOV1);  }
+    if (c == OCR1A) { TIFR1.v |= bit(OCF1A); }
+    return c;
+}
+
+void host_tcnt1_write(uint16_t c) { now = (now & ~0xFFFFULL) | c; }
+
+static void service()  // pending interrupts, highest priority first, flags cleared on entry
+{
+    if ((TIFR1 & bit(OCF1A)) && (TIMSK1 & bit(OCIE1A))) { TIFR1.v &= ~bit(OCF1A); TIMER1_COMPA_vect(); }
+    if ((TIFR1 & bit(TOV1))  && (TIMSK1 & bit(TOIE1)))  { TIFR1.v &= ~bit(TOV1);  TIMER1_OVF_vect();   }
+}
+
+static unsigned long long rs = 88172645463325252ULL;
+
+static unsigned long rnd(const unsigned long n)  // xorshift64
+{
+    rs ^= rs << 13;
+    rs ^= rs >> 7;
+    rs ^= rs << 17;
+    return (unsigned long)(rs % n);
+}
+
+static void randomize(const int trial)
+{
+    for (int n = 0; n < NCHAN; n++)
+    {
+        scpi.pulse_delay[n]  = rnd(3000);
+        scpi.pulse_period[n] = 20 + rnd((trial % 5 == 0) ? 80000 : 2000);
+        scpi.pulse_width[n]  = 1 + rnd(scpi.pulse_period[n] + 50);  // sometimes continuous
+        scpi.pulse_cycles[n] = rnd(6);
+        scpi.pulse_invert[n] = rnd(2);
+        if (rnd(4) == 0)  // coincident with channel 1, on the same or another port
+        {
+            scpi.pulse_delay[n]  = scpi.pulse_delay[0];
+            scpi.pulse_period[n] = scpi.pulse_period[0];
+        }
+    }
+}
+
+static void reference(std::vector<EDGE> &ref)  // ideal edges of the bank about to play, in sequence time
+{
+    for (int n = 0; n < NCHAN; n++)
+    {
+        if (!bank->active[n]) { continue; }
+
+        const unsigned long long kd = bank->k_delay[n], kw = bank->k_width[n], kp = bank->k_period[n];
+        const unsigned long long cycles = (bank->k_end[n] - kd) / kp;
+        const bool inv = bank->invert[n];
+        for (unsigned long long m = 0; m < cycles; m++)
+        {
+            if (m == 0 || kw < kp)          { ref.push_back({kd + m*kp,      n, !inv}); }
+            if (kw < kp || m == cycles - 1) { ref.push_back({kd + m*kp + kw, n, inv});  }
+        }
+    }
+}
+
+static int check(const int trial, const std::vector<EDGE> &got, const std::vector<EDGE> &ref, const unsigned long long t0,
+                 const unsigned long long t_trig, long long &late_max)
+{
+    int fails = 0;
+    for (int n = 0; n < NCHAN; n++)  // per channel: same edges, each on time
+    {
+        std::vector<EDGE> a, b;
+        for (const EDGE &e : got) { if (e.n == n) { a.push_back(e); } }
+        for (const EDGE &e : ref) { if (e.n == n) { b.push_back(e); } }
+
+        bool ok = (a.size() == b.size());
+        for (size_t i = 0; ok && i < a.size(); i++)
+        {
+            const unsigned long long due = max(t0 + b[i].t, t_trig);  // edges due before the trigger are written right away
+            const long long late = (long long)(a[i].t - due);
+            if (a[i].x != b[i].x || late < 0 || late > MAX_LATE) { ok = 0; }
+            if (late > late_max) { late_max = late; }
+        }
+        if (!ok)
+        {
+            fails++;
+            printf("trial %d, channel %d: %zu edges, expected %zu (DEL %ld, WID %ld, PER %ld, CYC %ld, INV %d)\n", trial, n + 1,
+                   a.size(), b.size(), scpi.pulse_delay[n], scpi.pulse_width[n], scpi.pulse_period[n], scpi.pulse_cycles[n], scpi.pulse_invert[n]);
+            for (size_t i = 0; i < max(a.size(), b.size()) && i < 8; i++)
+            {
+                printf("    got %12lld %d   expected %12lld %d\n", i < a.size() ? (long long)(a[i].t - t0) : -1LL, i < a.size() ? a[i].x : -1,
+                                                                     i < b.size() ? (long long)b[i].t : -1LL,     i < b.size() ? b[i].x : -1);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < got.size(); i++)  // across channels: written in order of their due time, coincident ones on a port together
+    {
+        for (size_t j = i + 1; j < got.size(); j++)
+        {
+            const EDGE &a = got[i], &b = got[j];
+            if (a.n == b.n) { continue; }  // checked above
+            unsigned long long ka = 0, kb = 0;
+            int ia = 0, ib = 0;
+            for (const EDGE &e : ref) { if (e.n == a.n && e.x == a.x && e.t + t0 <= a.t && e.t >= ka) { ka = e.t; ia = 1; } }
+            for (const EDGE &e : ref) { if (e.n == b.n && e.x == b.x && e.t + t0 <= b.t && e.t >= kb) { kb = e.t; ib = 1; } }
+            if (!ia || !ib) { continue; }  // already reported above
+            const bool tie = (max(t0 + ka, t_trig) == max(t0 + kb, t_trig));
+            if ((!tie && ka > kb) || (tie && conf_pulse_port[a.n] == conf_pulse_port[b.n] && a.t != b.t))
+            {
+                fails++;
+                printf("trial %d: channel %d (k %llu) written at %llu, channel %d (k %llu) at %llu\n",
+                       trial, a.n + 1, ka, a.t - t0, b.n + 1, kb, b.t - t0);
+            }
+            if (b.t > a.t + MAX_LATE) { break; }
+        }
+    }
+    return fails;
+}
+
+int main(int argc, char **argv)
+{
+    const int trials = argc > 1 ? atoi(argv[1]) : 300;
+    rs += argc > 2 ? atol(argv[2]) : 1;
+
+    int fails = 0, wraps = 0;
+    long edges = 0;
+    long long late_max = 0;
+    for (int trial = 0; trial < trials; trial++)
+    {
+        memset(host_eeprom, 0, sizeof(host_eeprom));
+        scpi_default(scpi);
+        EEPROM.put(EPA_SCPI, scpi);
+        now = 0;
+        c_ovf = 0;
+        TIFR1.v = 0;
+        setup();
+
+        if (trial > 0) { randomize(trial); for (int n = 0; n < NCHAN; n++) { update_pulse(n); } }
+        scpi_seq_length = 0;
+        if (trial % 3 == 1)  // play from a slot, after scrambling the live delays
+        {
+            bank_slot[trial % NSLOT] = bank_live;
+            for (int n = 0; n < NCHAN; n++) { scpi.pulse_delay[n] = rnd(5000); update_pulse(n); }
+            scpi_seq_length = NSLOT;
+            scpi_seq_index  = trial % NSLOT;
+        }
+        update_trig_ready();
+
+        std::vector<EDGE> ref;
+        reference(ref);
+
+        unsigned long long k_last = 0;
+        for (const EDGE &e : ref) { k_last = max(k_last, e.t); }
+        const bool wrap = (trial % 4 == 3);
+        now = wrap ? (1ULL << 48) - 1 - rnd(k_last + 1) : 100000 + rnd(70000);
+        c_ovf = (unsigned long)(now >> 16);
+        TIFR1.v = 0;
+        for (int n = 0; n < NCHAN; n++) { level[n] = out(n); }
+
+        std::vector<EDGE> got;
+        seen = &got;
+        const unsigned long long t_trig = now + 1;  // run_sw_trig() reads TCNT1 first
+        run_sw_trig();
+        const unsigned long long t0 = t_trig - k_start;
+        if (!ref.empty() && ((t_start ^ t0) & K_MASK) != 0)
+        {
+            fails++;
+            printf("trial %d: t_start %llx, expected %llx\n", trial, t_start, t0 & K_MASK);
+        }
+
+        const unsigned long long t_end = now + 20000000ULL;
+        while (seq_running && now < t_end)
+        {
+            host_tcnt1_read();
+            service();
+        }
+        observe();
+        seen = 0;
+
+        if (seq_running) { fails++; printf("trial %d: sequence did not finish\n", trial); seq_abort(); }
+        fails += check(trial, got, ref, t0, t_trig, late_max);
+        edges += got.size();
+        if (wrap && t_trig < (1ULL << 48) && now >= (1ULL << 48)) { wraps++; }
+    }
+
+    printf("%d trials (%d across the 48-bit wrap), %ld edges, max %lld ticks late, %d failures\n", trials, wraps, edges, late_max, fails);
+    printf("instants by port stores:");
+    for (int c = 1; c <= N_port; c++) { printf(" %d: %ld", c, stores[c]); }
+    printf(", estimated worst-case skew (model) %d cycles (%ld ns)\n", skew_max, (long)((long long)skew_max * 1000000000 / F_CPU));
+    return fails != 0;
+}
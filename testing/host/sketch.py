@@ -0,0 +1,55 @@
+# description: builds an instrument sketch together with a host driver (Linux, g++)
+
+# usage:
+#   python3 sketch.py <sketch.ino> <driver.cpp> <out> [g++ options]
+#   e.g. python3 sketch.py ../../instruments/arduino/pulsegen/pulsegen.ino sched_model.cpp sched_model -O2
+
+# notes:
+#   - like the Arduino IDE, adds prototypes of all functions defined in the sketch ahead of the first one,
+#     the driver is appended to the same translation unit (it sees every global, defines main(), and calls setup() itself)
+#   - the sketch directory and this one are on the include path, so the sketch gets the stand-ins for
+#     Arduino.h, EEPROM.h, Ethernet.h etc. from here and its own comm.h, parse.h, and eeprom/shared.h
+#   - compiled with -fpermissive like the IDE does (the sketches keep register addresses in plain byte pointers)
+#   - the generated source is kept as <out>.cpp for debugging
+
+import os
+import re
+import subprocess
+import sys
+
+here = os.path.dirname(os.path.abspath(__file__))
+
+definition = re.compile(r'^([A-Za-z_][\w\s\*&<>]*?[\s\*&]+)(\w+)\s*\(([^;{}]*)\)\s*(\{.*)?$')
+keywords   = ('if', 'else', 'while', 'for', 'switch', 'return', 'ISR')
+
+def prototypes(lines) :  # returns (index of first function definition, prototypes)
+    first  = None
+    protos = []
+    for i, l in enumerate(lines) :
+        l = re.sub(r'\s*//.*$', '', l)
+        m = definition.match(l)
+        if not m or l.startswith(keywords) : continue
+        body = m.group(4) or (i + 1 < len(lines) and lines[i + 1].strip().startswith('{'))
+        if not body : continue
+        if first is None : first = i
+        protos.append(m.group(1) + m.group(2) + '(' + m.group(3) + ');')
+    return first, protos
+
+def main() :
+    if len(sys.argv) < 4 :
+        sys.exit('usage: python3 sketch.py <sketch.ino> <driver.cpp> <out> [g++ options]')
+    ino, driver, out = sys.argv[1:4]
+
+    lines = open(ino).read().split('\n')
+    first, protos = prototypes(lines)
+    src  = '#include <Arduino.h>\n#line 1 "%s"\n' % ino
+    src += '\n'.join(lines[:first]) + '\n' + '\n'.join(protos) + '\n'
+    src += '#line %d "%s"\n' % (first + 1, ino) + '\n'.join(lines[first:]) + '\n'
+    src += '#line 1 "%s"\n' % driver + open(driver).read()
+    open(out + '.cpp', 'w').write(src)
+
+    cmd = ['g++', '-std=gnu++11', '-fpermissive', '-Wall', '-Wno-unused-variable', '-Wno-unused-but-set-variable',
+           '-I' + os.path.dirname(os.path.abspath(ino)), '-I' + here] + sys.argv[4:] + [out + '.cpp', os.path.join(here, 'host.cpp'), '-o', out]
+    sys.exit(subprocess.call(cmd))
+
+main()
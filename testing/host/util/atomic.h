@@ -0,0 +1,3 @@
+#pragma once
+
+#include <Arduino.h>  // ATOMIC_BLOCK is defined there